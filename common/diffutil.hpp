@@ -0,0 +1,289 @@
+
+#include "moab/Core.hpp"
+#include "moab/CartVect.hpp"
+
+#include "MBVHManager.h"
+#include "BruteForce.h"
+
+#include "rayutil.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+// Differential testing of MBVHManager queries against the MBBruteForce
+// reference engine. Query origins and directions are generated per volume
+// to target the cases that acceleration structures tend to get wrong.
+
+enum DiffQueryKind { DIFF_RANDOM = 0, // random origin in the volume bounds, random direction
+		     DIFF_VERTEX,     // aimed at a triangle vertex
+		     DIFF_EDGE,       // aimed at a point on a triangle edge
+		     DIFF_GRAZING,    // nearly parallel to a triangle, through its centroid
+		     DIFF_DISTANT,    // fired from far outside of the volume bounds
+		     DIFF_CLOSEST,    // closest location from a random point
+		     DIFF_NUM_KINDS };
+
+static const char* diff_kind_names[DIFF_NUM_KINDS] = { "random", "vertex", "edge", "grazing", "distant", "closest" };
+
+struct DiffStats {
+
+  DiffStats() : queries(0), hits(0), missed(0), extra(0), distances(0), attributes(0), ties(0), max_error(0.0) {}
+
+  size_t queries;
+  size_t hits;       // hits found by the reference
+  size_t missed;     // reference hit, BVH miss
+  size_t extra;      // BVH hit, reference miss
+  size_t distances;  // distances differ by more than the tolerance
+  size_t attributes; // same triangle but different surface or normal
+  size_t ties;       // same distance on a different triangle (shared edges/vertices)
+  double max_error;
+
+  size_t mismatches() const { return missed + extra + distances + attributes; }
+};
+
+class DiffHarness {
+
+ public:
+
+  DiffHarness(moab::Interface* mbi, MBVHManager* bvh, double tolerance = 1e-09)
+    : verbose(false), MBI(mbi), BVH(bvh), REF(mbi), tol(tolerance), current_vol(0) {}
+
+  // run num queries of the given kind on a volume
+  moab::ErrorCode run(moab::EntityHandle vol, DiffQueryKind kind, size_t num) {
+    moab::ErrorCode rval = load_volume(vol);
+    MB_CHK_SET_ERR(rval, "Failed to load the triangles of volume " << vol);
+
+    for(size_t i = 0; i < num; i++) {
+      MBRay bvh_ray, ref_ray;
+      generate(kind, bvh_ray);
+      bvh_ray.instID = vol;
+      ref_ray = bvh_ray;
+
+      if( DIFF_CLOSEST == kind ) {
+	rval = BVH->closestToLocation(bvh_ray);
+	MB_CHK_SET_ERR(rval, "Failed to find the closest location with the BVH");
+	rval = REF.closestToLocation(ref_ray);
+	MB_CHK_SET_ERR(rval, "Failed to find the closest location with the reference engine");
+      }
+      else {
+	rval = BVH->fireRay(bvh_ray);
+	MB_CHK_SET_ERR(rval, "Failed to fire ray with the BVH");
+	rval = REF.fireRay(ref_ray);
+	MB_CHK_SET_ERR(rval, "Failed to fire ray with the reference engine");
+      }
+
+      compare(kind, bvh_ray, ref_ray);
+    }
+
+    return moab::MB_SUCCESS;
+  }
+
+  // run num queries of every kind on a volume
+  moab::ErrorCode run_all(moab::EntityHandle vol, size_t num) {
+    for(int k = 0; k < DIFF_NUM_KINDS; k++) {
+      moab::ErrorCode rval = run(vol, (DiffQueryKind)k, num);
+      MB_CHK_SET_ERR(rval, "Failed differential run for volume " << vol);
+    }
+    return moab::MB_SUCCESS;
+  }
+
+  size_t mismatches() const {
+    size_t n = 0;
+    for(int k = 0; k < DIFF_NUM_KINDS; k++) n += stats[k].mismatches();
+    return n;
+  }
+
+  void report(std::ostream& os) const {
+    os << std::setw(10) << "kind" << std::setw(10) << "queries" << std::setw(10) << "hits"
+       << std::setw(10) << "missed" << std::setw(10) << "extra" << std::setw(10) << "dist"
+       << std::setw(10) << "attrib" << std::setw(10) << "ties" << std::setw(14) << "max error" << std::endl;
+    for(int k = 0; k < DIFF_NUM_KINDS; k++) {
+      const DiffStats& s = stats[k];
+      os << std::setw(10) << diff_kind_names[k] << std::setw(10) << s.queries << std::setw(10) << s.hits
+	 << std::setw(10) << s.missed << std::setw(10) << s.extra << std::setw(10) << s.distances
+	 << std::setw(10) << s.attributes << std::setw(10) << s.ties << std::setw(14) << s.max_error << std::endl;
+    }
+    os << "Total mismatches: " << mismatches() << std::endl;
+  }
+
+  DiffStats stats[DIFF_NUM_KINDS];
+
+  // print every mismatching query
+  bool verbose;
+
+ private:
+
+  moab::ErrorCode load_volume(moab::EntityHandle vol) {
+    if( vol == current_vol ) return moab::MB_SUCCESS;
+
+    moab::ErrorCode rval;
+
+    moab::Range surfs;
+    rval = MBI->get_child_meshsets(vol, surfs);
+    MB_CHK_SET_ERR(rval, "Failed to get child surfaces of volume " << vol);
+
+    std::vector<moab::EntityHandle> tris;
+    for(moab::Range::iterator si = surfs.begin(); si != surfs.end(); si++) {
+      rval = MBI->get_entities_by_type(*si, moab::MBTRI, tris);
+      MB_CHK_SET_ERR(rval, "Failed to get triangles for surface: " << *si);
+    }
+
+    if( tris.empty() ) { MB_CHK_SET_ERR(moab::MB_FAILURE, "No triangles found for volume " << vol); }
+
+    tri_coords.resize(3*tris.size());
+    for(size_t i = 0; i < tris.size(); i++) {
+      std::vector<moab::EntityHandle> conn;
+      rval = MBI->get_connectivity(&tris[i], 1, conn);
+      MB_CHK_SET_ERR(rval, "Failed to get triangle connectivity.");
+      rval = MBI->get_coords(&(conn[0]), 3, tri_coords[3*i].array());
+      MB_CHK_SET_ERR(rval, "Failed to get triangle vert coords");
+    }
+
+    lower = upper = tri_coords[0];
+    for(size_t i = 1; i < tri_coords.size(); i++) {
+      for(size_t j = 0; j < 3; j++) {
+	lower[j] = std::min(lower[j], tri_coords[i][j]);
+	upper[j] = std::max(upper[j], tri_coords[i][j]);
+      }
+    }
+
+    current_vol = vol;
+    return moab::MB_SUCCESS;
+  }
+
+  double rand_unit() { return denom * rand(); }
+
+  moab::CartVect rand_pnt() {
+    // random point in the volume bounds, extended by 10 percent
+    moab::CartVect ext = 0.1*(upper - lower);
+    moab::CartVect p;
+    for(size_t j = 0; j < 3; j++) p[j] = lower[j] - ext[j] + rand_unit()*(upper[j] - lower[j] + 2*ext[j]);
+    return p;
+  }
+
+  const moab::CartVect* rand_tri() {
+    size_t idx = rand() % (tri_coords.size()/3);
+    return &tri_coords[3*idx];
+  }
+
+  void generate(DiffQueryKind kind, MBRay& ray) {
+    moab::CartVect org, dir, target;
+    const moab::CartVect* tri;
+    size_t v;
+
+    switch(kind) {
+
+    case DIFF_VERTEX:
+      tri = rand_tri();
+      org = rand_pnt();
+      dir = tri[rand()%3] - org;
+      break;
+
+    case DIFF_EDGE:
+      tri = rand_tri();
+      v = rand()%3;
+      target = tri[v] + rand_unit()*(tri[(v+1)%3] - tri[v]);
+      org = rand_pnt();
+      dir = target - org;
+      break;
+
+    case DIFF_GRAZING:
+      {
+	tri = rand_tri();
+	moab::CartVect normal = (tri[1] - tri[0]) * (tri[2] - tri[0]);
+	moab::CartVect edge = tri[rand()%3] - tri[rand()%3];
+	if( normal.length() == 0.0 || edge.length() == 0.0 ) edge = tri[1] - tri[0];
+	if( normal.length() != 0.0 ) normal.normalize();
+	if( edge.length() != 0.0 ) edge.normalize();
+	dir = edge + (2.0*rand_unit() - 1.0)*1e-06*normal;
+	target = (tri[0] + tri[1] + tri[2])/3.0;
+	org = target - (upper - lower).length()*dir;
+      }
+      break;
+
+    case DIFF_DISTANT:
+      {
+	double dist = 1000.0*std::max(1.0, (upper - lower).length());
+	target = rand_pnt();
+	if( rand()%2 ) {
+	  // axis aligned, as in test_distant_rays
+	  dir = moab::CartVect(0.0, 0.0, 0.0);
+	  dir[rand()%3] = rand()%2 ? 1.0 : -1.0;
+	}
+	else {
+	  RNDVEC(dir);
+	}
+	org = target - dist*dir;
+      }
+      break;
+
+    case DIFF_CLOSEST:
+      org = rand_pnt();
+      ray = MBRay(Vec3da(org[0], org[1], org[2]), Vec3da(0.0, 0.0, 0.0), 0.0, inf);
+      return;
+
+    case DIFF_RANDOM:
+    default:
+      org = rand_pnt();
+      RNDVEC(dir);
+      break;
+    }
+
+    if( dir.length() == 0.0 ) dir = moab::CartVect(1.0, 0.0, 0.0);
+    dir.normalize();
+
+    // cycle through the orientation modes
+    int orientation = (rand()%3) - 1;
+
+    ray = MBRay(Vec3da(org[0], org[1], org[2]), Vec3da(dir[0], dir[1], dir[2]), 0.0, inf, -1, orientation);
+  }
+
+  void compare(DiffQueryKind kind, const MBRay& bvh_ray, const MBRay& ref_ray) {
+    DiffStats& s = stats[kind];
+    s.queries++;
+
+    bool bvh_hit = bvh_ray.primID != (moab::EntityHandle)-1;
+    bool ref_hit = ref_ray.primID != (moab::EntityHandle)-1;
+
+    if( ref_hit ) s.hits++;
+
+    if( !bvh_hit && !ref_hit ) return;
+
+    if( !bvh_hit ) { s.missed++; mismatch("missed", bvh_ray, ref_ray); return; }
+    if( !ref_hit ) { s.extra++; mismatch("extra", bvh_ray, ref_ray); return; }
+
+    double err = fabs(bvh_ray.tfar - ref_ray.tfar);
+    s.max_error = std::max(s.max_error, err);
+    if( err > tol*std::max(1.0, fabs(ref_ray.tfar)) ) {
+      s.distances++;
+      mismatch("distance", bvh_ray, ref_ray);
+      return;
+    }
+
+    if( bvh_ray.primID != ref_ray.primID ) { s.ties++; return; }
+
+    Vec3da dn = bvh_ray.Ng - ref_ray.Ng;
+    if( bvh_ray.geomID != ref_ray.geomID || dn.length() > tol ) {
+      s.attributes++;
+      mismatch("attribute", bvh_ray, ref_ray);
+    }
+  }
+
+  void mismatch(const char* what, const MBRay& bvh_ray, const MBRay& ref_ray) {
+    if( !verbose ) return;
+    std::cout << std::setprecision(17) << "Mismatch (" << what << ")" << std::endl
+	      << "Origin: " << ref_ray.org << " Direction: " << ref_ray.dir
+	      << " Orientation: " << ref_ray.orientation << std::endl
+	      << "BVH: " << bvh_ray.tfar << " " << bvh_ray.primID << " " << bvh_ray.geomID << std::endl
+	      << "Reference: " << ref_ray.tfar << " " << ref_ray.primID << " " << ref_ray.geomID << std::endl;
+  }
+
+  moab::Interface* MBI;
+  MBVHManager* BVH;
+  MBBruteForce REF;
+  double tol;
+
+  moab::EntityHandle current_vol;
+  std::vector<moab::CartVect> tri_coords;
+  moab::CartVect lower, upper;
+};
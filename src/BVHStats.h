@@ -7,6 +7,32 @@
 #include "Node.h"
 #include "Stack.h"
 
+// counters of the work done by single ray traversals, collected while a
+// tracker is set on the BVH (BVH::set_traversal_stats)
+struct TraversalStats {
+
+  inline TraversalStats() { reset(); }
+
+  inline void reset() { rays = nodes = boxes = culled = leaves = triangles = 0; }
+
+  unsigned long long rays;      // ray fires
+  unsigned long long nodes;     // interior nodes tested against the ray
+  unsigned long long boxes;     // child boxes hit
+  unsigned long long culled;    // stack entries dropped beyond the closest hit
+  unsigned long long leaves;    // non-empty leaves visited
+  unsigned long long triangles; // triangle intersection tests
+
+  inline void print(std::ostream& os) const {
+    double n = rays ? (double)rays : 1.0;
+    os << "Rays: " << rays << std::endl;
+    os << "Node box tests: " << nodes << " (" << nodes/n << " per ray)" << std::endl;
+    os << "Child boxes hit: " << boxes << " (" << boxes/n << " per ray)" << std::endl;
+    os << "Stack entries culled: " << culled << " (" << culled/n << " per ray)" << std::endl;
+    os << "Leaves visited: " << leaves << " (" << leaves/n << " per ray)" << std::endl;
+    os << "Triangle tests: " << triangles << " (" << triangles/n << " per ray)" << std::endl;
+  }
+};
+
 struct BVHStatTracker {
 
   // keeps track of the stack while traversing
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "moab/Core.hpp"
+#include "moab/CartVect.hpp"
+#include "moab/GeomUtil.hpp"
+#include "MBTagConventions.hpp"
+
+#include "MBVH.h"
+#include "TriangleIntersectors.h"
+
+/* Reference engine for the MBVHManager queries. Every triangle of a
+   volume is tested using the exact intersection and closest point
+   routines of the BVH, without any acceleration structure. Meant for
+   checking results, not for speed. */
+class MBBruteForce {
+
+  // triangle coordinates along with the surface and sense w.r.t. the volume
+  struct TriData {
+    moab::EntityHandle eh;
+    moab::EntityHandle surf;
+    int sense;
+    double xyz[9];
+
+    void coords(Vec3da c[3]) const {
+      for(size_t j = 0; j < 3; j++) c[j] = Vec3da(xyz[3*j], xyz[3*j+1], xyz[3*j+2]);
+    }
+  };
+
+ public:
+
+  MBBruteForce(moab::Interface* moab) : MBI(moab) {}
+
+  // fire a ray against all triangles of the volume ray.instID
+  moab::ErrorCode fireRay(MBRay &ray) {
+    const std::vector<TriData>* tris;
+    moab::ErrorCode rval = get_tris(ray.instID, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of volume " << ray.instID);
+
+    double huge_val = 1E37;
+    for(size_t i = 0; i < tris->size(); i++) {
+      const TriData& t = (*tris)[i];
+      Vec3da c[3];
+      t.coords(c);
+
+      const int orient = t.sense ? -ray.orientation : ray.orientation;
+
+      double dist;
+      bool hit = plucker_ray_tri_intersect(c, ray.org, ray.dir, dist, &huge_val,
+					   NULL, orient ? &orient : NULL);
+
+      if( hit && dist < ray.tfar && dist >= ray.tnear ) {
+	ray.tfar = dist;
+	ray.primID = t.eh;
+	ray.geomID = t.surf;
+	Vec3da normal = cross((c[1]-c[0]),(c[2]-c[0]));
+	ray.Ng = t.sense ? (normal * -1.0) : normal;
+	ray.Ng.normalize();
+      }
+    }
+
+    return moab::MB_SUCCESS;
+  }
+
+  // find the nearest location on the boundary of volume ray.instID
+  moab::ErrorCode closestToLocation(MBRay &ray) {
+    const std::vector<TriData>* tris;
+    moab::ErrorCode rval = get_tris(ray.instID, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get the triangles of volume " << ray.instID);
+
+    moab::CartVect location(ray.org[0], ray.org[1], ray.org[2]);
+    for(size_t i = 0; i < tris->size(); i++) {
+      const TriData& t = (*tris)[i];
+
+      moab::CartVect coords[3];
+      for(size_t j = 0; j < 3; j++) coords[j] = moab::CartVect(t.xyz + 3*j);
+
+      moab::CartVect closest_out;
+      moab::GeomUtil::closest_location_on_tri(location, coords, closest_out);
+
+      moab::CartVect vec = closest_out - location;
+      double dist = vec.length();
+      if( dist < ray.tfar ) {
+	ray.tfar = dist;
+	ray.primID = t.eh;
+	ray.geomID = t.surf;
+	moab::CartVect normal = ((coords[1]-coords[0]) * (coords[2]-coords[0]));
+	Vec3da norm = Vec3da(normal[0], normal[1], normal[2]);
+	ray.Ng = t.sense ? (norm * -1.0) : norm;
+	ray.Ng.normalize();
+	ray.dir = Vec3da(vec[0], vec[1], vec[2]);
+	ray.dir.normalize();
+      }
+    }
+
+    return moab::MB_SUCCESS;
+  }
+
+ private:
+
+  moab::ErrorCode get_tris(moab::EntityHandle vol, const std::vector<TriData>*& tris) {
+
+    std::map<moab::EntityHandle, std::vector<TriData> >::iterator it = volTris.find(vol);
+    if( it != volTris.end() ) {
+      tris = &(it->second);
+      return moab::MB_SUCCESS;
+    }
+
+    moab::ErrorCode rval;
+
+    moab::Tag sense_tag;
+    rval = MBI->tag_get_handle("GEOM_SENSE_2", sense_tag);
+    MB_CHK_SET_ERR(rval, "Failed to get the sense tag");
+
+    moab::Range surfs;
+    rval = MBI->get_child_meshsets(vol, surfs);
+    MB_CHK_SET_ERR(rval, "Failed to get child surfaces of volume " << vol);
+
+    std::vector<TriData>& vol_tris = volTris[vol];
+
+    for(moab::Range::iterator si = surfs.begin(); si != surfs.end(); si++) {
+      moab::EntityHandle senses[2];
+      rval = MBI->tag_get_data(sense_tag, &(*si), 1, (void*)senses);
+      MB_CHK_SET_ERR(rval, "Failed to get the sense data");
+
+      std::vector<moab::EntityHandle> surf_tris;
+      rval = MBI->get_entities_by_type(*si, moab::MBTRI, surf_tris);
+      MB_CHK_SET_ERR(rval, "Failed to get triangles for surface: " << *si);
+
+      for(size_t i = 0; i < surf_tris.size(); i++) {
+	TriData t;
+	t.eh = surf_tris[i];
+	t.surf = *si;
+	// same convention as the BVH set nodes
+	t.sense = senses[0] == vol ? 0 : 1;
+
+	std::vector<moab::EntityHandle> conn;
+	rval = MBI->get_connectivity(&(t.eh), 1, conn);
+	MB_CHK_SET_ERR(rval, "Failed to get triangle connectivity.");
+
+	rval = MBI->get_coords(&(conn[0]), 3, t.xyz);
+	MB_CHK_SET_ERR(rval, "Failed to get triangle vert coords");
+
+	vol_tris.push_back(t);
+      }
+    }
+
+    tris = &vol_tris;
+    return moab::MB_SUCCESS;
+  }
+
+  moab::Interface* MBI;
+  std::map<moab::EntityHandle, std::vector<TriData> > volTris;
+};
@@ -7,3 +7,19 @@ struct FilterT {
   typedef void(*FilterFunc)(RayT<V,P,I> &ray, void* mesh_ptr);
 };
 
+// Filter functor accepting every hit. Queries templated on it (see
+// BVH::intersectRayFiltered) compile without any filter code.
+struct NoFilter {
+  template<typename R>
+  inline void operator()(R &ray, void* mesh_ptr) const {}
+};
+
+// whether a filter type can reject hits
+template<typename F>
+struct FilterActive { static const bool value = true; };
+
+template<>
+struct FilterActive<NoFilter> { static const bool value = false; };
+
+template<>
+struct FilterActive<const NoFilter> { static const bool value = false; };
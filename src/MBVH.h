@@ -3,4 +3,7 @@
 #include "BVH.h"
 
 typedef RayT<Vec3da, double, moab::EntityHandle> MBRay;
+typedef RayHitT<double, moab::EntityHandle> MBRayHit;
+typedef RayHistoryT<moab::EntityHandle> MBRayHistory;
+typedef TrackCrossingT<double, moab::EntityHandle> MBTrackCrossing;
 typedef BVH<Vec3da, double, moab::EntityHandle> MBVH;
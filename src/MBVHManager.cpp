@@ -79,6 +79,12 @@ moab::ErrorCode MBVHManager::build( moab::Range geom_sets) {
 	  rval = MBI->get_child_meshsets(*ri, child_surfs);
 	  MB_CHK_SET_ERR(rval, "Failed to get child surfaces of volume" << *ri);
 
+	  if(flatVolumes) {
+	    rval = build_flat(*ri, child_surfs);
+	    MB_CHK_SET_ERR(rval, "Failed to build flat BVH for volume: " << *ri);
+	    break;
+	  }
+
 	  for(unsigned int i = 0; i < child_surfs.size(); i++){
 	    // make sure there are trees for all of these surfaces
 	    rval = build( child_surfs );
@@ -101,6 +107,51 @@ moab::ErrorCode MBVHManager::build( moab::Range geom_sets) {
     return rval;
   }
 
+moab::ErrorCode MBVHManager::build_flat(moab::EntityHandle vol, const moab::Range& surfs) {
+    std::vector<moab::EntityHandle> tris, tri_surfs;
+    std::vector<int> tri_senses;
+
+    for(moab::Range::const_iterator si = surfs.begin(); si != surfs.end(); si++) {
+      moab::EntityHandle fwd, rev;
+      rval = surface_senses(*si, fwd, rev);
+      MB_CHK_SET_ERR(rval, "Failed to get the senses of surface " << *si);
+
+      std::vector<moab::EntityHandle> surf_tris;
+      rval = MBI->get_entities_by_type(*si, moab::MBTRI, surf_tris);
+      MB_CHK_SET_ERR(rval, "Failed to get triangles for surface: " << *si);
+
+      tris.insert(tris.end(), surf_tris.begin(), surf_tris.end());
+      tri_surfs.resize(tris.size(), *si);
+      tri_senses.resize(tris.size(), fwd == vol ? 0 : 1);
+    }
+
+    NodeRef* root = MOABBVH->BuildFlat(tris.data(), tri_surfs.data(), tri_senses.data(), tris.size());
+    if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to build BVH for volume: " << vol); }
+    BVHRoots[vol - lowest_set] = root;
+
+    return moab::MB_SUCCESS;
+  }
+
+moab::ErrorCode MBVHManager::surface_senses(moab::EntityHandle surf, moab::EntityHandle &fwd, moab::EntityHandle &rev) {
+    NodeRef* surf_root = get_root(surf);
+    if(surf_root) {
+      MBVH::setSenses(*surf_root, fwd, rev);
+      return moab::MB_SUCCESS;
+    }
+
+    moab::Tag sense_tag;
+    rval = MBI->tag_get_handle("GEOM_SENSE_2", sense_tag);
+    MB_CHK_SET_ERR(rval, "Failed to get the sense tag");
+
+    moab::EntityHandle data[2];
+    rval = MBI->tag_get_data(sense_tag, &surf, 1, (void*)data);
+    MB_CHK_SET_ERR(rval, "Failed to get the sense data");
+
+    fwd = data[0];
+    rev = data[1];
+    return moab::MB_SUCCESS;
+  }
+
 moab::ErrorCode MBVHManager::build_all() {
     moab::ErrorCode rval;
 
@@ -122,6 +173,87 @@ moab::ErrorCode MBVHManager::build_all() {
   }
 
 
+moab::ErrorCode MBVHManager::build_scene_tree() {
+  moab::Range all_vols;
+  int dim = 3;
+  void *ptr = &dim;
+  moab::ErrorCode rval = MBI->get_entities_by_type_and_tag(0, moab::MBENTITYSET, &geom_dim_tag, &ptr, 1, all_vols);
+  MB_CHK_SET_ERR(rval, "Failed to retrieve volume entitysets");
+
+  std::vector<NodeRef*> roots;
+  std::vector<moab::EntityHandle> ids;
+  for(moab::Range::iterator vi = all_vols.begin(); vi != all_vols.end(); vi++) {
+    NodeRef* root = get_root(*vi);
+    if(!root) continue;
+    roots.push_back(root);
+    ids.push_back(*vi);
+  }
+  if(roots.empty()) { MB_CHK_SET_ERR(moab::MB_FAILURE, "No volume trees to build the scene tree from"); }
+
+  if(sceneRoot) MOABBVH->deleteSceneTree(sceneRoot);
+  sceneRoot = MOABBVH->buildSceneTree(&roots[0], &ids[0], roots.size());
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::build_grid( moab::EntityHandle vol, size_t resolution, size_t max_bytes ) {
+  NodeRef* root = get_root(vol);
+  if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << vol); }
+
+  // the cell centers are classified by pointInVolume, which must not
+  // answer from a grid built before
+  grids.erase(vol);
+
+  VolumeGrid grid;
+  if(!grid.setup(MOABBVH->box_from_node(root), resolution, max_bytes)) return moab::MB_SUCCESS;
+
+  const double half_diag = grid.halfDiagonal();
+  for(size_t c = 0; c < grid.size(); c++) {
+    const Vec3da center = grid.center(c);
+    MBRay ray(center, Vec3da(1.0, 0.0, 0.0));
+    const double safety = MOABBVH->safetyDistance(*root, ray);
+    if(safety <= half_diag) continue;
+
+    int inside;
+    moab::ErrorCode rval = pointInVolume(vol, center, inside);
+    MB_CHK_SET_ERR(rval, "Failed to classify the center of grid cell " << c);
+
+    // keep the stored bound from rounding up
+    const double bound = safety - half_diag;
+    float fbound = (float)bound;
+    if(fbound > bound) fbound = nextafterf(fbound, 0.0f);
+    grid.set(c, inside ? VolumeGrid::CELL_INSIDE : VolumeGrid::CELL_OUTSIDE, fbound);
+  }
+
+  grids[vol] = grid;
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::build_grids( size_t resolution, size_t max_bytes ) {
+  moab::Range all_vols;
+  int dim = 3;
+  void *ptr = &dim;
+  moab::ErrorCode rval = MBI->get_entities_by_type_and_tag(0, moab::MBENTITYSET, &geom_dim_tag, &ptr, 1, all_vols);
+  MB_CHK_SET_ERR(rval, "Failed to retrieve volume entitysets");
+
+  for(moab::Range::iterator vi = all_vols.begin(); vi != all_vols.end(); vi++) {
+    if(!get_root(*vi)) continue;
+    rval = build_grid(*vi, resolution, max_bytes / all_vols.size());
+    MB_CHK_SET_ERR(rval, "Failed to build the grid of volume " << *vi);
+  }
+
+  return moab::MB_SUCCESS;
+}
+
+// the grid cell of vol containing point, NULL if there is no grid or the
+// boundary may pass through the cell
+static inline const VolumeGrid* grid_cell(const std::map<moab::EntityHandle, VolumeGrid> &grids, moab::EntityHandle vol, const Vec3da &point, size_t &c) {
+  if(grids.empty()) return NULL;
+  std::map<moab::EntityHandle, VolumeGrid>::const_iterator it = grids.find(vol);
+  if(it == grids.end() || !it->second.cell(point, c)) return NULL;
+  if(it->second.label(c) == VolumeGrid::CELL_BOUNDARY) return NULL;
+  return &it->second;
+}
+
 moab::ErrorCode MBVHManager::fireRay( MBRay &ray ) {
   NodeRef* root = get_root(ray.instID);
   if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << ray.instID); }
@@ -129,6 +261,349 @@ moab::ErrorCode MBVHManager::fireRay( MBRay &ray ) {
   return moab::MB_SUCCESS;
 }
 
+moab::ErrorCode MBVHManager::fireRays( MBRay *rays, size_t num_rays ) {
+  std::vector<NodeRef*> roots(num_rays);
+  for(size_t i = 0; i < num_rays; i++) {
+    roots[i] = get_root(rays[i].instID);
+    if(!roots[i]) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << rays[i].instID); }
+  }
+  if(num_rays) MOABBVH->intersectRays(&roots[0], rays, num_rays);
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::fireOcclusionRay( MBRay &ray, bool &occluded ) {
+  NodeRef* root = get_root(ray.instID);
+  if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << ray.instID); }
+  occluded = MOABBVH->occluded(*root, ray);
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::fireOcclusionRays( MBRay *rays, size_t num_rays, std::vector<bool> &occluded ) {
+  std::vector<NodeRef*> roots(num_rays);
+  for(size_t i = 0; i < num_rays; i++) {
+    roots[i] = get_root(rays[i].instID);
+    if(!roots[i]) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << rays[i].instID); }
+  }
+  occluded.clear();
+  if(num_rays) MOABBVH->occluded(&roots[0], rays, num_rays, occluded);
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::fireRayAllHits( const MBRay &ray, MBRayHit *hits, size_t max_hits, size_t &num_hits ) {
+  NodeRef* root = get_root(ray.instID);
+  if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << ray.instID); }
+  num_hits = MOABBVH->intersectAll(*root, ray, hits, max_hits);
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::fireRayAllHits( const MBRay &ray, std::vector<MBRayHit> &hits ) {
+  // grow the buffer until it holds all hits
+  size_t num_hits = 0;
+  hits.resize(std::max(hits.capacity(), (size_t)16));
+  while (true) {
+    moab::ErrorCode rval = fireRayAllHits(ray, &hits[0], hits.size(), num_hits);
+    MB_CHK_SET_ERR(rval, "Failed to fire ray");
+    if (num_hits < hits.size()) break;
+    hits.resize(2*hits.size());
+  }
+  hits.resize(num_hits);
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::fireRayPackets( MBRay *rays, size_t num_rays, size_t packet_size ) {
+  if(packet_size != 4 && packet_size != 8) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Unsupported ray packet size " << packet_size); }
+
+  size_t i = 0;
+  while(i < num_rays) {
+    NodeRef* root = get_root(rays[i].instID);
+    if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << rays[i].instID); }
+
+    size_t n = 1;
+    while(n < packet_size && i+n < num_rays && rays[i+n].instID == rays[i].instID) n++;
+
+    if(packet_size == 4) MOABBVH->intersectPacket<4>(*root, rays+i, n);
+    else MOABBVH->intersectPacket<8>(*root, rays+i, n);
+    i += n;
+  }
+
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::walkTrack( const MBRay &ray, std::vector<MBTrackCrossing> &crossings ) {
+  crossings.clear();
+
+  // the ray keeps its origin throughout, so the traversal ray is set up once.
+  // Only exits count, so facets at a shared edge or vertex of the crossing
+  // cannot be hit again on the way into the next volume.
+  MBRay track = ray;
+  track.orientation = ORIENT_FORWARD;
+  TravRayT<moab::EntityHandle> vray(track.org, track.dir);
+  MBRayHistory history;
+  if(ray.history) history = *ray.history;
+  track.history = &history;
+
+  moab::EntityHandle vol = ray.instID;
+  while(vol && (crossings.empty() || vol != graveyard)) {
+    NodeRef* root = get_root(vol);
+    if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << vol); }
+
+    track.instID = vol;
+    track.tfar = ray.tfar;
+    track.geomID = -1;
+    track.primID = -1;
+    MOABBVH->intersectRay(*root, track, vray);
+    if(track.geomID == -1) break;
+
+    moab::EntityHandle fwd, rev;
+    rval = surface_senses(track.geomID, fwd, rev);
+    MB_CHK_SET_ERR(rval, "Failed to get the senses of surface " << track.geomID);
+
+    MBTrackCrossing crossing;
+    crossing.volume = vol;
+    crossing.surface = track.geomID;
+    crossing.primID = track.primID;
+    crossing.dist = track.tfar;
+    crossing.next = fwd == vol ? rev : fwd;
+    crossings.push_back(crossing);
+
+    // carry on from the crossing, skipping the triangles crossed there
+    if(track.tfar > track.tnear) history.reset();
+    history.add(track.primID);
+    track.tnear = track.tfar;
+    vol = crossing.next;
+  }
+
+  return moab::MB_SUCCESS;
+}
+
+// ray directions for point containment, away from the axes and the
+// diagonals along which the facets of many models line up
+static const double piv_dirs[][3] = { { 0.5213,  0.2347,  0.8205},
+                                      {-0.3851,  0.7924, -0.4731},
+                                      { 0.8762, -0.4109, -0.2517},
+                                      {-0.2293, -0.6815,  0.6950},
+                                      { 0.1637,  0.9420,  0.2930},
+                                      {-0.7396,  0.1402, -0.6583} };
+static const size_t piv_num_dirs = sizeof(piv_dirs)/sizeof(piv_dirs[0]);
+
+// hits this close to a facet edge (in barycentric coordinates) or at
+// this small a cosine to the facet are refired in another direction
+static const double piv_edge_tol = 1e-6;
+static const double piv_graze_tol = 1e-3;
+
+static inline MBRay piv_ray(moab::EntityHandle vol, const Vec3da &point, size_t i) {
+  Vec3da dir(piv_dirs[i][0], piv_dirs[i][1], piv_dirs[i][2]);
+  dir.normalize();
+  MBRay ray(point, dir);
+  ray.instID = vol;
+  return ray;
+}
+
+// containment from the first hit of a ray fired from the point, false if
+// the hit is too close to an edge or grazes the facet to be trusted
+static inline bool piv_classify(const MBRay &ray, int &result) {
+  if (ray.geomID == -1) { result = 0; return true; }
+  const double cosine = dot(ray.Ng, ray.dir);
+  result = cosine > 0.0 ? 1 : 0;
+  const double w = 1.0 - ray.u - ray.v;
+  if (std::min(w, std::min(ray.u, ray.v)) < piv_edge_tol) return false;
+  return fabs(cosine) >= piv_graze_tol;
+}
+
+moab::ErrorCode MBVHManager::pointInVolume( moab::EntityHandle vol, const Vec3da &point, int &result, int mode ) {
+  size_t c;
+  const VolumeGrid* grid = grid_cell(grids, vol, point, c);
+  if(grid) {
+    result = grid->label(c) == VolumeGrid::CELL_INSIDE ? 1 : 0;
+    return moab::MB_SUCCESS;
+  }
+
+  NodeRef* root = get_root(vol);
+  if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << vol); }
+
+  if(mode != PIV_RAY && mode != PIV_CLOSEST) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Unknown point in volume mode " << mode); }
+
+  if(mode == PIV_RAY) {
+    // the filter set on the tree could reject the hits that classify the
+    // point, the rays are fired without one
+    NoFilter no_filter;
+    for(size_t i = 0; i < piv_num_dirs; i++) {
+      MBRay ray = piv_ray(vol, point, i);
+      MOABBVH->intersectRayFiltered(*root, ray, no_filter);
+      if(piv_classify(ray, result)) return moab::MB_SUCCESS;
+    }
+    // every ray ran into an edge or vertex or grazed a facet, as from
+    // points on the boundary, so use the nearest boundary feature instead
+  }
+
+  double dist;
+  moab::ErrorCode rval = signedDistance(vol, point, dist);
+  MB_CHK_SET_ERR(rval, "Failed to get the signed distance to volume " << vol);
+  result = dist < 0.0 ? 1 : 0;
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::pointsInVolume( moab::EntityHandle vol, const Vec3da *points, size_t num_points, std::vector<int> &results, int mode ) {
+  results.resize(num_points);
+  for(size_t i = 0; i < num_points; i++) {
+    moab::ErrorCode rval = pointInVolume(vol, points[i], results[i], mode);
+    MB_CHK_SET_ERR(rval, "Failed to classify point " << i);
+  }
+  return moab::MB_SUCCESS;
+}
+
+// vertex indices and coordinates of a triangle
+static inline void tri_verts(const MOABDirectAccessManager* mdam, moab::EntityHandle tri, size_t v[3], Vec3da c[3]) {
+  const moab::EntityHandle* conn = mdam->conn + (tri - mdam->first_element)*mdam->element_stride;
+  for(size_t i = 0; i < 3; i++) {
+    v[i] = conn[i] - 1;
+    c[i] = Vec3da(mdam->xPtr[v[i]], mdam->yPtr[v[i]], mdam->zPtr[v[i]]);
+  }
+}
+
+moab::ErrorCode MBVHManager::build_pseudo_normals( moab::EntityHandle vol ) {
+  moab::Range surfs;
+  rval = MBI->get_child_meshsets(vol, surfs);
+  MB_CHK_SET_ERR(rval, "Failed to get child surfaces of volume " << vol);
+
+  PseudoNormals& normals = pseudoNormals[vol];
+  normals = PseudoNormals();
+
+  for(moab::Range::iterator si = surfs.begin(); si != surfs.end(); si++) {
+    moab::EntityHandle fwd, rev;
+    rval = surface_senses(*si, fwd, rev);
+    MB_CHK_SET_ERR(rval, "Failed to get the senses of surface " << *si);
+
+    std::vector<moab::EntityHandle> tris;
+    rval = MBI->get_entities_by_type(*si, moab::MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get triangles for surface: " << *si);
+
+    // orient the triangles out of the volume
+    for(size_t i = 0; i < tris.size(); i++) {
+      size_t v[3];
+      Vec3da c[3];
+      tri_verts(MDAM, tris[i], v, c);
+      if(fwd != vol) { std::swap(v[1], v[2]); std::swap(c[1], c[2]); }
+      normals.add(v, c);
+    }
+  }
+
+  return moab::MB_SUCCESS;
+}
+
+// feature tolerance on the barycentric coordinates of the nearest point
+static const double sd_feature_tol = 1e-9;
+
+moab::ErrorCode MBVHManager::signedDistance( moab::EntityHandle vol, const Vec3da &point, double &dist ) {
+  NodeRef* root = get_root(vol);
+  if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << vol); }
+
+  std::map<moab::EntityHandle, PseudoNormals>::const_iterator it = pseudoNormals.find(vol);
+  if(it == pseudoNormals.end()) {
+    moab::ErrorCode rval = build_pseudo_normals(vol);
+    MB_CHK_SET_ERR(rval, "Failed to build the pseudo-normals of volume " << vol);
+    it = pseudoNormals.find(vol);
+  }
+
+  MBRay ray(point, Vec3da(1.0, 0.0, 0.0));
+  ray.instID = vol;
+  MOABBVH->intersectClosest(*root, ray);
+  if(ray.primID == (moab::EntityHandle)-1) { MB_CHK_SET_ERR(moab::MB_FAILURE, "No boundary found for volume " << vol); }
+
+  dist = ray.tfar;
+  if(dist == 0.0) return moab::MB_SUCCESS;
+
+  // find the feature of the triangle the nearest point is on from its
+  // barycentric coordinates, zero for the vertices it is away from
+  size_t v[3];
+  Vec3da c[3];
+  tri_verts(MDAM, ray.primID, v, c);
+  const Vec3da nearest = point + ray.tfar * ray.dir;
+  const Vec3da e1 = c[1]-c[0], e2 = c[2]-c[0], w = nearest-c[0];
+  const double d11 = dot(e1, e1), d12 = dot(e1, e2), d22 = dot(e2, e2);
+  const double dw1 = dot(w, e1), dw2 = dot(w, e2);
+  const double inv_denom = 1.0 / (d11 * d22 - d12 * d12);
+  double b[3];
+  b[1] = (d22 * dw1 - d12 * dw2) * inv_denom;
+  b[2] = (d11 * dw2 - d12 * dw1) * inv_denom;
+  b[0] = 1.0 - b[1] - b[2];
+
+  size_t on[3], num_on = 0;
+  for(size_t i = 0; i < 3; i++) if(b[i] > sd_feature_tol) on[num_on++] = i;
+
+  Vec3da normal;
+  if(num_on == 1) normal = it->second.vertex(v[on[0]]);
+  else if(num_on == 2) normal = it->second.edge(v[on[0]], v[on[1]]);
+  else normal = ray.Ng;
+
+  if(dot(point - nearest, normal) < 0.0) dist = -dist;
+
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::signedDistances( moab::EntityHandle vol, const Vec3da *points, size_t num_points, std::vector<double> &dists ) {
+  dists.resize(num_points);
+  for(size_t i = 0; i < num_points; i++) {
+    moab::ErrorCode rval = signedDistance(vol, points[i], dists[i]);
+    MB_CHK_SET_ERR(rval, "Failed to get the signed distance of point " << i);
+  }
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::safetyDistance( moab::EntityHandle vol, const Vec3da &point, double &dist, size_t max_depth, double max_dist ) {
+  size_t c;
+  const VolumeGrid* grid = grid_cell(grids, vol, point, c);
+  if(grid) {
+    dist = std::min((double)grid->bound(c), max_dist);
+    return moab::MB_SUCCESS;
+  }
+
+  NodeRef* root = get_root(vol);
+  if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << vol); }
+  MBRay ray(point, Vec3da(1.0, 0.0, 0.0), 0.0, max_dist);
+  dist = MOABBVH->safetyDistance(*root, ray, max_depth);
+  return moab::MB_SUCCESS;
+}
+
+// test the candidate volumes in order until one contains the point
+static inline moab::ErrorCode find_in(MBVHManager &manager, const Vec3da &point, const std::vector<moab::EntityHandle> &candidates, moab::EntityHandle &vol) {
+  vol = 0;
+  for(size_t i = 0; i < candidates.size(); i++) {
+    int inside;
+    moab::ErrorCode rval = manager.pointInVolume(candidates[i], point, inside);
+    MB_CHK_SET_ERR(rval, "Failed to test point containment in volume " << candidates[i]);
+    if(inside) { vol = candidates[i]; break; }
+  }
+  return moab::MB_SUCCESS;
+}
+
+moab::ErrorCode MBVHManager::findVolume( const Vec3da &point, moab::EntityHandle &vol ) {
+  if(!sceneRoot) { MB_CHK_SET_ERR(moab::MB_FAILURE, "No scene tree, call build_scene_tree first"); }
+
+  std::vector<moab::EntityHandle> candidates;
+  MOABBVH->setsContaining(*sceneRoot, point, candidates);
+  return find_in(*this, point, candidates, vol);
+}
+
+moab::ErrorCode MBVHManager::findVolumes( const Vec3da *points, size_t num_points, std::vector<moab::EntityHandle> &vols ) {
+  if(!sceneRoot) { MB_CHK_SET_ERR(moab::MB_FAILURE, "No scene tree, call build_scene_tree first"); }
+
+  vols.resize(num_points);
+  std::vector<moab::EntityHandle> candidates;
+  moab::EntityHandle last = 0;
+  for(size_t i = 0; i < num_points; i++) {
+    MOABBVH->setsContaining(*sceneRoot, points[i], candidates);
+
+    std::vector<moab::EntityHandle>::iterator it = std::find(candidates.begin(), candidates.end(), last);
+    if(it != candidates.end()) std::iter_swap(candidates.begin(), it);
+
+    moab::ErrorCode rval = find_in(*this, points[i], candidates, vols[i]);
+    MB_CHK_SET_ERR(rval, "Failed to find the volume of point " << i);
+    if(vols[i]) last = vols[i];
+  }
+  return moab::MB_SUCCESS;
+}
+
 moab::ErrorCode MBVHManager::fireRaySurf( MBRay &ray ) {
   NodeRef* root = get_root(ray.geomID);
   if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << ray.geomID); }
@@ -2,12 +2,15 @@
 
 #include <iostream>
 #include <string>
+#include <map>
 
 #include "moab/Core.hpp"
 #include "MBTagConventions.hpp"
 
 #include "MBVH.h"
 #include "MOABDirectAccessManager.h"
+#include "PseudoNormals.h"
+#include "VolumeGrid.h"
 
 inline void output_w_border(std::string message) {
   std::string border(message.size(), '=');
@@ -16,6 +19,9 @@ inline void output_w_border(std::string message) {
 }
   
 
+// point containment methods, see MBVHManager::pointInVolume
+enum PointInVolumeMode { PIV_RAY = 0, PIV_CLOSEST = 1 };
+
 class MBVHManager {
  public:
   
@@ -29,8 +35,26 @@ class MBVHManager {
   moab::EntityHandle lowest_set;
 
   moab::Tag geom_dim_tag;
+
+  // volume at which walkTrack stops, 0 if none
+  moab::EntityHandle graveyard;
+
+  // pseudo-normals of the volumes queried by signedDistance
+  std::map<moab::EntityHandle, PseudoNormals> pseudoNormals;
+
+  // classification grids of the volumes, see build_grid
+  std::map<moab::EntityHandle, VolumeGrid> grids;
+
+  // tree over all volume trees, see build_scene_tree
+  NodeRef* sceneRoot;
+
+  // Build volume trees as single level trees over the triangles of all
+  // their surfaces rather than joining surface trees. Suits volumes of
+  // many small surfaces. The triangles of surfaces between two volumes
+  // are stored once per volume, and surface trees are not built.
+  bool flatVolumes;
   
-  MBVHManager(moab::Interface* moab) : MBI(moab), rval(moab::MB_SUCCESS), MDAM(NULL)
+  MBVHManager(moab::Interface* moab) : MBI(moab), rval(moab::MB_SUCCESS), MDAM(NULL), graveyard(0), sceneRoot(NULL), flatVolumes(false)
   {
     initialize();
   };
@@ -101,10 +125,135 @@ class MBVHManager {
   
   moab::ErrorCode build_all();
 
+  // build the flat tree of a volume over the triangles of surfs, see flatVolumes
+  moab::ErrorCode build_flat(moab::EntityHandle vol, const moab::Range& surfs);
+
+  // the volumes on the forward and reverse sides of a surface, from its
+  // tree if it has one
+  moab::ErrorCode surface_senses(moab::EntityHandle surf, moab::EntityHandle &fwd, moab::EntityHandle &rev);
+
+  // Build a grid over the box of vol with resolution cells along its
+  // longest side, fewer if the grid would take more than max_bytes. Each
+  // cell the boundary cannot pass through (by safetyDistance from its
+  // center) is labelled inside or outside, with a lower bound on the
+  // distance to the boundary. pointInVolume and safetyDistance answer
+  // points in those cells from the grid. The tree of vol must be built.
+  moab::ErrorCode build_grid(moab::EntityHandle vol, size_t resolution = 32, size_t max_bytes = 1 << 24);
+
+  // build_grid for all volumes, max_bytes is shared between them
+  moab::ErrorCode build_grids(size_t resolution = 32, size_t max_bytes = 1 << 26);
+
+  // build the tree over the boxes of all volume trees built, needed by
+  // findVolume. Rebuild it after building more volume trees.
+  moab::ErrorCode build_scene_tree();
+
   moab::ErrorCode fireRay(MBRay &ray);
 
+  // fire a batch of rays, each against the volume in its instID
+  moab::ErrorCode fireRays(MBRay *rays, size_t num_rays);
+
+  // fire rays in packets of packet_size (4 or 8), consecutive rays
+  // against the same volume are grouped into a packet
+  moab::ErrorCode fireRayPackets(MBRay *rays, size_t num_rays, size_t packet_size = 8);
+
+  // true in occluded if the ray hits the volume boundary between ray.tnear
+  // and ray.tfar. Stops at the first hit found, only ray.tfar and ray.primID
+  // are set for it.
+  moab::ErrorCode fireOcclusionRay(MBRay &ray, bool &occluded);
+
+  // occlusion query for a batch of rays, each against the volume in its instID
+  moab::ErrorCode fireOcclusionRays(MBRay *rays, size_t num_rays, std::vector<bool> &occluded);
+
+  // hits of the ray with the volume boundary between ray.tnear and
+  // ray.tfar, sorted by distance. At most max_hits of them are written to
+  // hits, the nearest ones. The ray is not modified.
+  moab::ErrorCode fireRayAllHits(const MBRay &ray, MBRayHit *hits, size_t max_hits, size_t &num_hits);
+
+  // all hits of the ray with the volume boundary, sorted by distance
+  moab::ErrorCode fireRayAllHits(const MBRay &ray, std::vector<MBRayHit> &hits);
+
+  // The queries above with a filter functor passed for this call only,
+  // rather than the filter set on the tree. See BVH::intersectRayFiltered.
+  template<typename F>
+  moab::ErrorCode fireRay(MBRay &ray, F &filter) {
+    NodeRef* root = get_root(ray.instID);
+    if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << ray.instID); }
+    MOABBVH->intersectRayFiltered(*root, ray, filter);
+    return moab::MB_SUCCESS;
+  }
+
+  template<typename F>
+  moab::ErrorCode fireOcclusionRay(MBRay &ray, bool &occluded, F &filter) {
+    NodeRef* root = get_root(ray.instID);
+    if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << ray.instID); }
+    occluded = MOABBVH->occludedFiltered(*root, ray, filter);
+    return moab::MB_SUCCESS;
+  }
+
+  template<typename F>
+  moab::ErrorCode fireRayAllHits(const MBRay &ray, MBRayHit *hits, size_t max_hits, size_t &num_hits, F &filter) {
+    NodeRef* root = get_root(ray.instID);
+    if(!root) { MB_CHK_SET_ERR(moab::MB_FAILURE, "Failed to retrieve the root for EntitySet " << ray.instID); }
+    num_hits = MOABBVH->intersectAllFiltered(*root, ray, hits, max_hits, filter);
+    return moab::MB_SUCCESS;
+  }
+
+  // Follow the ray from the volume in ray.instID through the volumes it
+  // crosses into, using the senses of the surfaces hit. The crossings up
+  // to ray.tfar are written to crossings in order. The walk ends where
+  // the ray leaves the model, or on entering the graveyard. Distances are
+  // measured from ray.org. Triangles in ray.history are skipped until
+  // the first crossing.
+  moab::ErrorCode walkTrack(const MBRay &ray, std::vector<MBTrackCrossing> &crossings);
+
+  // Whether point lies inside the volume vol, result is 1 if it does and
+  // 0 if not. PIV_RAY fires a ray from the point and takes the sense of
+  // the first facet hit, refiring in another direction if the hit is on
+  // or near an edge or vertex, or grazes the facet, and falling back to
+  // PIV_CLOSEST if no direction gives a clean hit. PIV_CLOSEST uses the
+  // sign of signedDistance, from the nearest face, edge or vertex of
+  // the boundary. The closest point search costs more than a ray, even
+  // for points near the boundary, so PIV_CLOSEST is for callers that want
+  // the answer of the nearest boundary feature. Points on the boundary
+  // may be either.
+  moab::ErrorCode pointInVolume(moab::EntityHandle vol, const Vec3da &point, int &result, int mode = PIV_RAY);
+
+  // pointInVolume for a batch of points
+  moab::ErrorCode pointsInVolume(moab::EntityHandle vol, const Vec3da *points, size_t num_points, std::vector<int> &results, int mode = PIV_RAY);
+
+  // compute the angle-weighted pseudo-normals of the boundary of vol,
+  // done by signedDistance on the first query of a volume
+  moab::ErrorCode build_pseudo_normals(moab::EntityHandle vol);
+
+  // distance from point to the boundary of vol, negative inside. The
+  // sign comes from the pseudo-normal of the nearest boundary feature
+  // (face, edge or vertex), so it is exact for closed boundaries.
+  moab::ErrorCode signedDistance(moab::EntityHandle vol, const Vec3da &point, double &dist);
+
+  // signedDistance for a batch of points
+  moab::ErrorCode signedDistances(moab::EntityHandle vol, const Vec3da *points, size_t num_points, std::vector<double> &dists);
+
+  // Lower bound on the distance from point to the boundary of vol, from
+  // the tree boxes down to max_depth levels below the root (to the leaves
+  // by default). Never more than the true distance. The search stops at
+  // max_dist, which is returned if the boundary may be further.
+  // See BVH::safetyDistance. For points in the inside or outside cells of
+  // a grid the bound of the cell is returned instead, which is looser.
+  moab::ErrorCode safetyDistance(moab::EntityHandle vol, const Vec3da &point, double &dist, size_t max_depth = (size_t)-1, double max_dist = inf);
+
+  // The volume containing point, 0 if it is in none of them. Only the
+  // volumes whose boxes contain the point are tested, by pointInVolume,
+  // which answers from the volume grids where there are any.
+  moab::ErrorCode findVolume(const Vec3da &point, moab::EntityHandle &vol);
+
+  // findVolume for a batch of points. The volume found for the previous
+  // point is tested first, which suits points sampled close together.
+  moab::ErrorCode findVolumes(const Vec3da *points, size_t num_points, std::vector<moab::EntityHandle> &vols);
+
   moab::ErrorCode fireRaySurf(MBRay &ray);
 
+  // nearest point on the volume boundary to ray.org, ray.tfar on input
+  // limits the search radius (primID remains -1 if nothing is found)
   moab::ErrorCode closestToLocation(MBRay & ray);
 
   moab::ErrorCode closestToLocationSurf(MBRay & ray);
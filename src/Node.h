@@ -270,30 +270,105 @@ __forceinline size_t intersectBox(const AANode &node, const TravRayT<I> &ray, co
   return mask;
 };
 
+// intersectBox specialized on the ray direction octant OCT (bit 0: -x,
+// bit 1: -y, bit 2: -z), the near and far planes are selected at compile time
+template<int OCT, typename I>
+__forceinline size_t intersectBoxOctant(const AANode &node, const TravRayT<I> &ray, const vfloat4 &tnear, const vfloat4 &tfar, vfloat4 &dist) {
+  const vfloat4& nearX = (OCT & 1) ? node.upper_x : node.lower_x;
+  const vfloat4& nearY = (OCT & 2) ? node.upper_y : node.lower_y;
+  const vfloat4& nearZ = (OCT & 4) ? node.upper_z : node.lower_z;
+  const vfloat4& farX  = (OCT & 1) ? node.lower_x : node.upper_x;
+  const vfloat4& farY  = (OCT & 2) ? node.lower_y : node.upper_y;
+  const vfloat4& farZ  = (OCT & 4) ? node.lower_z : node.upper_z;
+#if defined(__AVX2__)
+  const vfloat4 tNearX = msub(nearX, ray.rdir.x, ray.org_rdir.x);
+  const vfloat4 tNearY = msub(nearY, ray.rdir.y, ray.org_rdir.y);
+  const vfloat4 tNearZ = msub(nearZ, ray.rdir.z, ray.org_rdir.z);
+  const vfloat4 tFarX  = msub(farX, ray.rdir.x, ray.org_rdir.x);
+  const vfloat4 tFarY  = msub(farY, ray.rdir.y, ray.org_rdir.y);
+  const vfloat4 tFarZ  = msub(farZ, ray.rdir.z, ray.org_rdir.z);
+#else
+  const vfloat4 tNearX = (nearX - ray.org.x) * ray.rdir.x;
+  const vfloat4 tNearY = (nearY - ray.org.y) * ray.rdir.y;
+  const vfloat4 tNearZ = (nearZ - ray.org.z) * ray.rdir.z;
+  const vfloat4 tFarX = (farX - ray.org.x) * ray.rdir.x;
+  const vfloat4 tFarY = (farY - ray.org.y) * ray.rdir.y;
+  const vfloat4 tFarZ = (farZ - ray.org.z) * ray.rdir.z;
+#endif
+
+  const float round_down = 1.0f-2.0f*float(ulp);
+  const float round_up   = 1.0f+2.0f*float(ulp);
+
+#if defined(__SSE4_1__)
+  const vfloat4 tNear = maxi(tNearX,tNearY,tNearZ,tnear);
+  const vfloat4 tFar  = mini(tFarX ,tFarY ,tFarZ ,tfar);
+  const vbool4 vmask = round_down*tNear > round_up*tFar;
+  const size_t mask = movemask(vmask) ^ ((1<<4)-1);
+#else
+  const vfloat4 tNear = max(tNearX, tNearY, tNearZ, tnear);
+  const vfloat4 tFar = min(tFarX, tFarY, tFarZ, tfar);
+  const vbool4 vmask = (round_down*tNear <= round_up*tFar);
+  const size_t mask = movemask(vmask);
+#endif
+
+  dist = tNear;
+  return mask;
+};
+
+// intersect child i of a node with the active lanes of a ray packet,
+// returns the mask of lanes hitting the child box and their entry distances
+template<typename I, int K>
+__forceinline size_t intersectBoxPacket(const AANode &node, size_t i, const TravRayPacketT<I,K> &packet, size_t active, vfloat4 dist[K/4]) {
+  const vfloat4 lowerX(node.lower_x[i]), upperX(node.upper_x[i]);
+  const vfloat4 lowerY(node.lower_y[i]), upperY(node.upper_y[i]);
+  const vfloat4 lowerZ(node.lower_z[i]), upperZ(node.upper_z[i]);
+
+  const float round_down = 1.0f-2.0f*float(ulp);
+  const float round_up   = 1.0f+2.0f*float(ulp);
+
+  size_t mask = 0;
+  for (size_t b = 0; b < K/4; b++) {
+    if (!((active >> 4*b) & 15)) continue;
+
+    // near and far planes differ between lanes, order them per lane
+    const vfloat4 t0X = (lowerX - packet.org[b].x) * packet.rdir[b].x;
+    const vfloat4 t1X = (upperX - packet.org[b].x) * packet.rdir[b].x;
+    const vfloat4 t0Y = (lowerY - packet.org[b].y) * packet.rdir[b].y;
+    const vfloat4 t1Y = (upperY - packet.org[b].y) * packet.rdir[b].y;
+    const vfloat4 t0Z = (lowerZ - packet.org[b].z) * packet.rdir[b].z;
+    const vfloat4 t1Z = (upperZ - packet.org[b].z) * packet.rdir[b].z;
+
+    const vfloat4 tNear = max(min(t0X, t1X), min(t0Y, t1Y), min(t0Z, t1Z), packet.tnear[b]);
+    const vfloat4 tFar  = min(max(t0X, t1X), max(t0Y, t1Y), max(t0Z, t1Z), packet.tfar[b]);
+    const vbool4 vmask = (round_down*tNear <= round_up*tFar);
+    mask |= movemask(vmask) << 4*b;
+    dist[b] = tNear;
+  }
+
+  return mask & active;
+};
+
+// squared distance from the ray origin to each child box, children
+// further than the squared search radius in tfar are culled
 template<typename I>
 __forceinline size_t nearestOnBox(const AANode &node, const TravRayT<I> &ray, const vfloat4 &tnear, const vfloat4 &tfar, vfloat4 &dist) {
 
-  // find the center of the boxes
-  const vfloat4 centerX = (node.lower_x+node.upper_x)*0.5;
-  const vfloat4 centerY = (node.lower_y+node.upper_y)*0.5;
-  const vfloat4 centerZ = (node.lower_z+node.upper_z)*0.5;
+  // per-axis distance from the ray origin to the box, zero if
+  // the origin is between the box planes
+  const vfloat4 zero4(0.0f);
+  const vfloat4 dX = max(node.lower_x - ray.org.x, ray.org.x - node.upper_x, zero4);
+  const vfloat4 dY = max(node.lower_y - ray.org.y, ray.org.y - node.upper_y, zero4);
+  const vfloat4 dZ = max(node.lower_z - ray.org.z, ray.org.z - node.upper_z, zero4);
 
-  // compute the vector from the ray origin to the box center
-  const vfloat4 tminX = node.lower_x - ray.org.x;
-  const vfloat4 tminY = node.lower_y - ray.org.y;
-  const vfloat4 tminZ = node.lower_z - ray.org.z;
-  const vfloat4 tmaxX = ray.org.x - node.upper_x;
-  const vfloat4 tmaxY = ray.org.y - node.upper_y;
-  const vfloat4 tmaxZ = ray.org.z - node.upper_z;
+  const vfloat4 distSq = dX*dX + dY*dY + dZ*dZ;
 
-  vfloat4 tX = max(tminX, tmaxX);
-  vfloat4 tY = max(tminY, tmaxY);
-  vfloat4 tZ = max(tminZ, tmaxZ);
+  const float round_down = 1.0f-2.0f*float(ulp);
 
-  dist = max(tX,tY,tZ);
+  const vbool4 vmask = round_down*distSq <= tfar;
+  const size_t mask = movemask(vmask);
 
-  // we claim to "intersect" all boxes
-  return 15;
+  dist = distSq;
+  return mask;
 };
 
 #endif
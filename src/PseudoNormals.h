@@ -0,0 +1,75 @@
+#pragma once
+
+#include <unordered_map>
+#include <algorithm>
+#include <math.h>
+
+#include "Vec3da.h"
+
+// Angle-weighted pseudo-normals of the vertices and edges of a closed
+// triangle mesh (Baerentzen and Aanaes). The sign of the distance to the
+// mesh follows from the pseudo-normal of the feature (face, edge or
+// vertex) nearest the point, which the normal of a single facet does not
+// give when that feature is an edge or vertex. Vertices are indexed as in
+// the vertex coordinate arrays. Normals are left unnormalized, only their
+// direction is used.
+class PseudoNormals {
+
+ public:
+
+  inline PseudoNormals() {}
+
+  // add a triangle with vertex indices v and coordinates c, oriented so
+  // that its normal points out of the volume
+  inline void add(const size_t v[3], const Vec3da c[3]) {
+    Vec3da n = cross(c[1]-c[0], c[2]-c[0]);
+    n.normalize();
+
+    for (size_t i = 0; i < 3; i++) {
+      const size_t j = (i+1)%3, k = (i+2)%3;
+
+      // weight the vertex by the angle of the triangle at it
+      Vec3da e1 = c[j]-c[i], e2 = c[k]-c[i];
+      e1.normalize();
+      e2.normalize();
+      const double angle = acos(std::max(-1.0, std::min(1.0, dot(e1, e2))));
+      add_to(vertexNormals, v[i], n * angle);
+
+      // both faces of an edge have the same weight
+      add_to(edgeNormals, edge_key(v[i], v[j]), n);
+    }
+  }
+
+  inline Vec3da vertex(size_t v) const { return get(vertexNormals, v); }
+
+  inline Vec3da edge(size_t a, size_t b) const { return get(edgeNormals, edge_key(a, b)); }
+
+  inline bool empty() const { return vertexNormals.empty(); }
+
+ private:
+
+  // plain doubles, map nodes do not get the 32 byte alignment of Vec3da
+  struct Normal { double x, y, z; };
+  typedef std::unordered_map<size_t, Normal> NormalMap;
+
+  static inline size_t edge_key(size_t a, size_t b) {
+    return (std::min(a, b) << 32) | std::max(a, b);
+  }
+
+  static inline void add_to(NormalMap &normals, size_t key, const Vec3da &n) {
+    Normal& sum = normals[key];
+    sum.x += n.x;
+    sum.y += n.y;
+    sum.z += n.z;
+  }
+
+  static inline Vec3da get(const NormalMap &normals, size_t key) {
+    NormalMap::const_iterator it = normals.find(key);
+    if (it == normals.end()) return Vec3da(0.0, 0.0, 0.0);
+    return Vec3da(it->second.x, it->second.y, it->second.z);
+  }
+
+  NormalMap vertexNormals;
+  NormalMap edgeNormals;
+
+};
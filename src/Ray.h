@@ -8,20 +8,26 @@
 #include "vdouble.h"
 
 #include "sys.h"
+#include "RayHistory.h"
 
 #include <immintrin.h>
 
+/* Orientation screening for ray queries. Forward hits are those where the
+   ray exits the volume through the facet, reverse hits are those where it
+   enters. Resolved against the surface sense during traversal. */
+enum RayOrientation { ORIENT_REVERSE = -1, ORIENT_ANY = 0, ORIENT_FORWARD = 1 };
+
 template<typename V, typename P, typename I>
 struct RayT {
 
   /* Empty Constructor */
-  __forceinline RayT() {}
+  __forceinline RayT() : orientation(ORIENT_ANY), history(NULL) {}
   
   /* RayT Constructor */
   __forceinline RayT(const V& org, const V &dir,
 	     const P& tnear = zero, const P& tfar = inf,
-	     const int mask = -1)
-    : org(org), dir(dir), tnear(tnear), tfar(tfar), mask(mask), geomID(-1), primID(-1), instID(-1), u(0.0f), v(0.0f) { Ng = V(); }
+	     const int mask = -1, const int orientation = ORIENT_ANY)
+    : org(org), dir(dir), tnear(tnear), tfar(tfar), mask(mask), orientation(orientation), geomID(-1), primID(-1), instID(-1), history(NULL), u(0.0f), v(0.0f) { Ng = V(); }
 
 
   
@@ -40,6 +46,7 @@ struct RayT {
   P tnear;
   P tfar;
   int mask;
+  int orientation; // RayOrientation, ORIENT_ANY by default
 
   /* Hit data */
   V Ng; // tri normal
@@ -49,6 +56,8 @@ struct RayT {
   I primID; // triangle ID (equivalent to triangle EntityHandle)
   I instID; // kernel instance ID (might be able to replace with volume EntityHandle
 
+  const RayHistoryT<I>* history; // triangles not to hit, NULL if none
+
 };
 
 template<typename v, typename p, typename i>
@@ -67,6 +76,25 @@ template<typename v, typename p, typename i>
             << "Geometry ID: " << r.geomID << std::endl;
 }
 
+// a hit along a ray as collected by multi-hit queries
+template<typename P, typename I>
+struct RayHitT {
+  P dist; // distance along the ray
+  I primID; // triangle ID
+  I setID; // surface ID
+  int sense; // sense of the surface w.r.t. the volume queried, 0 forward, 1 reverse
+};
+
+// a surface crossing along the track of a ray through the model
+template<typename P, typename I>
+struct TrackCrossingT {
+  I volume; // volume the track leaves
+  I surface; // surface crossed
+  I primID; // triangle crossed
+  P dist; // distance along the ray
+  I next; // volume the track enters, 0 if none
+};
+
 typedef RayT<Vec3fa, float, int> Ray;
 typedef RayT<Vec3da, double, int> dRay;
 
@@ -80,7 +108,7 @@ struct TravRayT {
     __forceinline TravRayT() {}
 
     __forceinline TravRayT(const Vec3fa &ray_org, const Vec3fa &ray_dir)
-      : org_xyz(ray_org), dir_xyz(ray_dir) {
+      : org_xyz(ray_org), dir_xyz(ray_dir), sense(0) {
       rdir = rcp_safe(dir_xyz);
       org = ray_org;
       dir = ray_dir;
@@ -98,7 +126,7 @@ struct TravRayT {
 
 
   __forceinline TravRayT(const Vec3da &ray_org, const Vec3da &ray_dir)
-      : org_xyz(ray_org), dir_xyz(ray_dir) {
+      : org_xyz(ray_org), dir_xyz(ray_dir), sense(0) {
       rdir = rcp_safe(dir_xyz);
       org = ray_org;
       dir = ray_dir;
@@ -114,6 +142,11 @@ struct TravRayT {
       farZ  = nearZ ^ sizeof(vfloat4);
     }
   
+    // direction octant of the ray (bit 0: -x, bit 1: -y, bit 2: -z)
+    __forceinline size_t octant() const {
+      return (nearX != 0*sizeof(vfloat4)) | ((nearY != 2*sizeof(vfloat4)) << 1) | ((nearZ != 4*sizeof(vfloat4)) << 2);
+    }
+
     Vec3fa org_xyz, dir_xyz;
     Vec3vf org, dir, rdir;
     Vec3vf tnear;
@@ -127,3 +160,48 @@ struct TravRayT {
   };
 
 typedef TravRayT<unsigned> TravRay;
+
+/* Structure of arrays counterpart of TravRayT for a packet of K rays
+   (K a multiple of 4) fired against the same tree. Lanes are stored in
+   blocks of four, the set state is shared by all lanes. */
+template<typename I, int K>
+struct TravRayPacketT {
+
+  enum { size = K, blocks = K/4 };
+
+  __forceinline TravRayPacketT() : sense(0), setID() {
+    for (size_t b = 0; b < blocks; b++) {
+      org[b] = Vec3vf(vfloat4(0.0f), vfloat4(0.0f), vfloat4(0.0f));
+      rdir[b] = Vec3vf(vfloat4(0.0f), vfloat4(0.0f), vfloat4(0.0f));
+      tnear[b] = inf;
+      tfar[b] = neg_inf;
+    }
+  }
+
+  // load a ray into lane k
+  template<typename R>
+  __forceinline void set(size_t k, const R &ray) {
+    const Vec3fa o = ray.org;
+    const Vec3fa r = rcp_safe(Vec3fa(ray.dir));
+    const size_t b = k >> 2, l = k & 3;
+    org[b].x[l] = o.x; org[b].y[l] = o.y; org[b].z[l] = o.z;
+    rdir[b].x[l] = r.x; rdir[b].y[l] = r.y; rdir[b].z[l] = r.z;
+    tnear[b][l] = std::max(ray.tnear, 0.0);
+    tfar[b][l] = std::max(ray.tfar, 0.0);
+  }
+
+  // update the far distance of lane k after a hit
+  __forceinline void setFar(size_t k, double t) { tfar[k >> 2][k & 3] = std::max(t, 0.0); }
+
+  // mask of lanes whose far distance reaches dist
+  __forceinline size_t reaches(float dist) const {
+    size_t mask = 0;
+    for (size_t b = 0; b < blocks; b++) mask |= movemask(vfloat4(dist) <= tfar[b]) << 4*b;
+    return mask;
+  }
+
+  Vec3vf org[blocks], rdir[blocks];
+  vfloat4 tnear[blocks], tfar[blocks];
+  int sense;
+  I setID;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+// Triangles a ray must not hit, as for a particle streaming off the
+// surface it just crossed. Set on a ray (RayT::history), the triangles
+// are skipped in the leaves before the intersection test. Histories are
+// short, so lookup is a linear search from the most recent entry.
+template<typename I>
+class RayHistoryT {
+
+ public:
+
+  inline RayHistoryT() {}
+
+  // add a triangle, usually the primID of the last hit
+  inline void add(I eh) { facets.push_back(eh); }
+
+  // clear the history
+  inline void reset() { facets.clear(); }
+
+  // keep only the most recent triangle
+  inline void reset_to_last() {
+    if (facets.size() > 1) { facets.erase(facets.begin(), facets.end()-1); }
+  }
+
+  // remove the most recent triangle
+  inline void rollback() {
+    if (!facets.empty()) facets.pop_back();
+  }
+
+  // most recent triangle, the history must not be empty
+  inline I last() const { return facets.back(); }
+
+  inline bool contains(I eh) const {
+    return std::find(facets.rbegin(), facets.rend(), eh) != facets.rend();
+  }
+
+  inline size_t size() const { return facets.size(); }
+
+  inline bool empty() const { return facets.empty(); }
+
+ private:
+  std::vector<I> facets;
+
+};
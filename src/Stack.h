@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include "sys.h"
+
 
 template<typename T>
 struct StackItemT {
@@ -61,3 +63,41 @@ public:
   unsigned dist;
 
 };
+
+// storage for a traversal stack of N items. The items are left
+// uninitialized, a local array of them would construct every node
+// reference on each traversal.
+template<typename Item, size_t N>
+struct StackStorageT {
+
+  __forceinline Item* begin() { return (Item*)data; }
+
+  char data[sizeof(Item)*N] __aligned(16);
+
+};
+
+// stack entry of the short stack traversal, which also records
+// where the node sits in the restart trail
+template<typename T>
+struct ShortStackItemT {
+
+public:
+  T ptr;
+  float dist;
+  unsigned short level; // level of the parent node
+  unsigned char rank;   // position of the node among its siblings, nearest first
+  unsigned char last;   // set if this is the farthest sibling hit
+
+};
+
+// stack entry of the packet traversal, holding the lanes that hit the
+// node and the nearest of their entry distances
+template<typename T>
+struct PacketStackItemT {
+
+public:
+  T ptr;
+  float dist;
+  unsigned mask; // zero for the marker of a set tree
+
+};
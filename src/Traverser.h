@@ -8,6 +8,10 @@
 
 //#define VERBOSE_MODE
 
+// policy for the order in which the children of a node are visited
+enum ChildOrder { CHILD_ORDER_DISTANCE = 0,      // sort by box distance (traverseClosest)
+		  CHILD_ORDER_DISTANCE_SIMD };   // sort by box distance (traverseClosestSIMD)
+
 class BVHTraverser {
  public:
 
@@ -115,6 +119,70 @@ class BVHTraverser {
     sort(stackPtr[-1], stackPtr[-2], stackPtr[-3], stackPtr[-4]);
     current_node = (NodeRef) stackPtr[-1].ptr; stackPtr--;
   }
+
+  // Same result as traverseClosest, but the children hit are ordered with
+  // a sorting network on packed (distance, child) keys and written to the
+  // stack in one go. The two low bits of each distance hold the child index,
+  // so stored distances are rounded down (conservative for culling). Up to
+  // four stack entries are written past stackPtr, only the farther hits are kept.
+  static inline void traverseClosestSIMD(NodeRef& current_node,
+					 size_t mask,
+					 const vfloat4& tNear,
+					 StackItemT<NodeRef>*& stackPtr,
+					 StackItemT<NodeRef>* stackEnd)
+  {
+    assert(mask != 0);
+    const Node* node = current_node.bnode();
+
+    /* single hit, no ordering needed */
+    if((mask & (mask - 1)) == 0) {
+      current_node = node->child(__bsf(mask));
+      current_node.prefetch();
+      return;
+    }
+
+#if defined(__AVX2__)
+    assert(stackPtr + 4 <= stackEnd);
+
+    const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+    const __m128i bits = _mm_set_epi32(8, 4, 2, 1);
+    const __m128i hit = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int)mask), bits), bits);
+
+    // keys of children not hit are zero and sort behind all others
+    __m128i key = _mm_or_si128(_mm_and_si128(_mm_castps_si128(tNear.v), _mm_set1_epi32(0x7FFFFFFC)), lanes);
+    key = _mm_and_si128(key, hit);
+
+    // sort descending: (0,1)(2,3), (0,2)(1,3), (1,2)
+    __m128i o = _mm_shuffle_epi32(key, _MM_SHUFFLE(2, 3, 0, 1));
+    key = _mm_blend_epi16(_mm_max_epu32(key, o), _mm_min_epu32(key, o), 0xCC);
+    o = _mm_shuffle_epi32(key, _MM_SHUFFLE(1, 0, 3, 2));
+    key = _mm_blend_epi16(_mm_max_epu32(key, o), _mm_min_epu32(key, o), 0xF0);
+    o = _mm_shuffle_epi32(key, _MM_SHUFFLE(3, 1, 2, 0));
+    key = _mm_blend_epi16(_mm_max_epu32(key, o), _mm_min_epu32(key, o), 0x30);
+
+    // gather the child references in sorted order
+    const __m256i idx = _mm256_cvtepu32_epi64(_mm_and_si128(key, _mm_set1_epi32(3)));
+    const __m256i idx2 = _mm256_add_epi32(_mm256_slli_epi32(_mm256_or_si256(idx, _mm256_slli_epi64(idx, 32)), 1),
+					  _mm256_set_epi32(1, 0, 1, 0, 1, 0, 1, 0));
+    const __m256i refs = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)node->children), idx2);
+
+    // interleave references and distances into stack items
+    const __m256i dists = _mm256_cvtepu32_epi64(_mm_andnot_si128(_mm_set1_epi32(3), key));
+    const __m256i lo = _mm256_unpacklo_epi64(refs, dists);
+    const __m256i hi = _mm256_unpackhi_epi64(refs, dists);
+    _mm256_storeu_si256((__m256i*)stackPtr, _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)(stackPtr + 2), _mm256_permute2x128_si256(lo, hi, 0x31));
+
+    // the nearest child is traversed next, the others stay on the stack
+    const size_t n = __popcnt(mask);
+    stackPtr += n - 1;
+    current_node = stackPtr->ptr;
+    current_node.prefetch();
+#else
+    traverseClosest(current_node, mask, tNear, stackPtr, stackEnd);
+#endif
+  }
+
     
   
 };
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "Vec3da.h"
+#include "vdouble.h"
+#include "vbool.h"
+#include "sys.h"
+
+/* Closest point on four triangles at once. Vertex coordinates are passed
+   in SoA form, one triangle per lane. The closest point is expressed as
+   a + s*(b-a) + t*(c-a) and (s,t) is found using the same region
+   classification and arithmetic as moab::GeomUtil::closest_location_on_tri
+
+   D. Eberly, "Distance Between Point and Triangle in 3D",
+   Geometric Tools (1999)
+
+   Every region is evaluated and the result is selected per lane rather
+   than branched on. Returns the squared distance from the location to the
+   closest point of each triangle. */
+#if defined(__AVX2__)
+
+inline vdouble4 closest_location_on_tri4( const Vec3da& location,
+					  const vdouble4& vax, const vdouble4& vay, const vdouble4& vaz,
+					  const vdouble4& vbx, const vdouble4& vby, const vdouble4& vbz,
+					  const vdouble4& vcx, const vdouble4& vcy, const vdouble4& vcz,
+					  vdouble4& qx, vdouble4& qy, vdouble4& qz) {
+
+  const __m256d zero4 = _mm256_setzero_pd(), one4 = _mm256_set1_pd(1.0);
+  const __m256d sign4 = _mm256_set1_pd(-0.0);
+
+  const __m256d ax = _mm256_loadu_pd(vax.f), ay = _mm256_loadu_pd(vay.f), az = _mm256_loadu_pd(vaz.f);
+  const __m256d px = _mm256_set1_pd(location.x), py = _mm256_set1_pd(location.y), pz = _mm256_set1_pd(location.z);
+
+  const __m256d svx = _mm256_sub_pd(_mm256_loadu_pd(vbx.f), ax);
+  const __m256d svy = _mm256_sub_pd(_mm256_loadu_pd(vby.f), ay);
+  const __m256d svz = _mm256_sub_pd(_mm256_loadu_pd(vbz.f), az);
+  const __m256d tvx = _mm256_sub_pd(_mm256_loadu_pd(vcx.f), ax);
+  const __m256d tvy = _mm256_sub_pd(_mm256_loadu_pd(vcy.f), ay);
+  const __m256d tvz = _mm256_sub_pd(_mm256_loadu_pd(vcz.f), az);
+  const __m256d pvx = _mm256_sub_pd(ax, px), pvy = _mm256_sub_pd(ay, py), pvz = _mm256_sub_pd(az, pz);
+
+#define DOT4(ax, ay, az, bx, by, bz) _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ax, bx), _mm256_mul_pd(ay, by)), _mm256_mul_pd(az, bz))
+  const __m256d ss = DOT4(svx, svy, svz, svx, svy, svz);
+  const __m256d st = DOT4(svx, svy, svz, tvx, tvy, tvz);
+  const __m256d tt = DOT4(tvx, tvy, tvz, tvx, tvy, tvz);
+  const __m256d sp = DOT4(svx, svy, svz, pvx, pvy, pvz);
+  const __m256d tp = DOT4(tvx, tvy, tvz, pvx, pvy, pvz);
+#undef DOT4
+
+  const __m256d det = _mm256_sub_pd(_mm256_mul_pd(ss, tt), _mm256_mul_pd(st, st));
+  const __m256d s0 = _mm256_sub_pd(_mm256_mul_pd(st, tp), _mm256_mul_pd(tt, sp));
+  const __m256d t0 = _mm256_sub_pd(_mm256_mul_pd(st, sp), _mm256_mul_pd(ss, tp));
+
+  const __m256d inside = _mm256_cmp_pd(_mm256_add_pd(s0, t0), det, _CMP_LT_OQ);
+  const __m256d s_neg = _mm256_cmp_pd(s0, zero4, _CMP_LT_OQ);
+  const __m256d t_neg = _mm256_cmp_pd(t0, zero4, _CMP_LT_OQ);
+
+  // clamped parameters along the edges t = 0 and s = 0
+  const __m256d nsp = _mm256_xor_pd(sp, sign4), ntp = _mm256_xor_pd(tp, sign4);
+  const __m256d s_edge = _mm256_blendv_pd(_mm256_blendv_pd(_mm256_div_pd(nsp, ss), one4, _mm256_cmp_pd(nsp, ss, _CMP_GE_OQ)),
+					  zero4, _mm256_cmp_pd(sp, zero4, _CMP_GE_OQ));
+  const __m256d t_edge = _mm256_blendv_pd(_mm256_blendv_pd(_mm256_div_pd(ntp, tt), one4, _mm256_cmp_pd(ntp, tt, _CMP_GE_OQ)),
+					  zero4, _mm256_cmp_pd(tp, zero4, _CMP_GE_OQ));
+
+  const __m256d denom = _mm256_add_pd(_mm256_sub_pd(ss, _mm256_mul_pd(_mm256_set1_pd(2.0), st)), tt);
+
+  // region 0, interior
+  const __m256d inv_det = _mm256_div_pd(one4, det);
+  __m256d s = _mm256_mul_pd(s0, inv_det);
+  __m256d t = _mm256_mul_pd(t0, inv_det);
+
+  // outside of the s + t < 1 half-space: regions 1, 2 and 6
+  const __m256d numer1 = _mm256_sub_pd(_mm256_sub_pd(_mm256_add_pd(tt, tp), st), sp);
+  const __m256d s1 = _mm256_blendv_pd(_mm256_blendv_pd(_mm256_div_pd(numer1, denom), one4, _mm256_cmp_pd(numer1, denom, _CMP_GE_OQ)),
+				      zero4, _mm256_cmp_pd(numer1, zero4, _CMP_LE_OQ));
+
+  const __m256d tmp1_2 = _mm256_add_pd(tt, tp), tmp0_2 = _mm256_add_pd(st, sp);
+  const __m256d numer2 = _mm256_sub_pd(tmp1_2, tmp0_2);
+  const __m256d bc_2 = _mm256_cmp_pd(tmp1_2, tmp0_2, _CMP_GT_OQ);
+  const __m256d s2 = _mm256_blendv_pd(_mm256_div_pd(numer2, denom), one4, _mm256_cmp_pd(numer2, denom, _CMP_GE_OQ));
+
+  const __m256d tmp1_6 = _mm256_add_pd(ss, sp), tmp0_6 = _mm256_add_pd(st, tp);
+  const __m256d numer6 = _mm256_sub_pd(tmp1_6, tmp0_6);
+  const __m256d bc_6 = _mm256_cmp_pd(tmp1_6, tmp0_6, _CMP_GT_OQ);
+  const __m256d t6 = _mm256_blendv_pd(_mm256_div_pd(numer6, denom), one4, _mm256_cmp_pd(numer6, denom, _CMP_GE_OQ));
+
+  __m256d s_out = _mm256_blendv_pd(s1, _mm256_blendv_pd(s_edge, _mm256_sub_pd(one4, t6), bc_6), t_neg);
+  __m256d t_out = _mm256_blendv_pd(_mm256_sub_pd(one4, s1), _mm256_blendv_pd(zero4, t6, bc_6), t_neg);
+  s_out = _mm256_blendv_pd(s_out, _mm256_blendv_pd(zero4, s2, bc_2), s_neg);
+  t_out = _mm256_blendv_pd(t_out, _mm256_blendv_pd(t_edge, _mm256_sub_pd(one4, s2), bc_2), s_neg);
+
+  // inside of the s + t < 1 half-space: regions 0, 3, 4 and 5
+  const __m256d ab_4 = _mm256_cmp_pd(sp, zero4, _CMP_LT_OQ);
+  __m256d s_in = _mm256_blendv_pd(s, s_edge, t_neg);
+  __m256d t_in = _mm256_blendv_pd(t, zero4, t_neg);
+  s_in = _mm256_blendv_pd(s_in, _mm256_blendv_pd(zero4, _mm256_and_pd(s_edge, ab_4), t_neg), s_neg);
+  t_in = _mm256_blendv_pd(t_in, _mm256_blendv_pd(t_edge, _mm256_andnot_pd(ab_4, t_edge), t_neg), s_neg);
+
+  s = _mm256_blendv_pd(s_out, s_in, inside);
+  t = _mm256_blendv_pd(t_out, t_in, inside);
+
+  const __m256d cqx = _mm256_add_pd(_mm256_add_pd(ax, _mm256_mul_pd(s, svx)), _mm256_mul_pd(t, tvx));
+  const __m256d cqy = _mm256_add_pd(_mm256_add_pd(ay, _mm256_mul_pd(s, svy)), _mm256_mul_pd(t, tvy));
+  const __m256d cqz = _mm256_add_pd(_mm256_add_pd(az, _mm256_mul_pd(s, svz)), _mm256_mul_pd(t, tvz));
+  _mm256_storeu_pd(qx.f, cqx);
+  _mm256_storeu_pd(qy.f, cqy);
+  _mm256_storeu_pd(qz.f, cqz);
+
+  const __m256d dx = _mm256_sub_pd(cqx, px), dy = _mm256_sub_pd(cqy, py), dz = _mm256_sub_pd(cqz, pz);
+  vdouble4 dist_sq;
+  _mm256_storeu_pd(dist_sq.f, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz)));
+  return dist_sq;
+}
+
+#else
+
+inline vdouble4 closest_location_on_tri4( const Vec3da& location,
+					  const vdouble4& ax, const vdouble4& ay, const vdouble4& az,
+					  const vdouble4& bx, const vdouble4& by, const vdouble4& bz,
+					  const vdouble4& cx, const vdouble4& cy, const vdouble4& cz,
+					  vdouble4& qx, vdouble4& qy, vdouble4& qz) {
+
+  const vdouble4 zero4(0.0), one4(1.0);
+
+  const vdouble4 svx = bx - ax, svy = by - ay, svz = bz - az;
+  const vdouble4 tvx = cx - ax, tvy = cy - ay, tvz = cz - az;
+  const vdouble4 pvx = ax - location.x, pvy = ay - location.y, pvz = az - location.z;
+
+  const vdouble4 ss = svx*svx + svy*svy + svz*svz;
+  const vdouble4 st = svx*tvx + svy*tvy + svz*tvz;
+  const vdouble4 tt = tvx*tvx + tvy*tvy + tvz*tvz;
+  const vdouble4 sp = svx*pvx + svy*pvy + svz*pvz;
+  const vdouble4 tp = tvx*pvx + tvy*pvy + tvz*pvz;
+
+  const vdouble4 det = ss*tt - st*st;
+  const vdouble4 s0 = st*tp - tt*sp;
+  const vdouble4 t0 = st*sp - ss*tp;
+
+  const vbool4 inside = s0 + t0 < det;
+  const vbool4 s_neg = s0 < zero4;
+  const vbool4 t_neg = t0 < zero4;
+  const vbool4 s_pos = s0 >= zero4;
+  const vbool4 t_pos = t0 >= zero4;
+
+  // clamped parameters along the edges t = 0 and s = 0
+  const vdouble4 s_edge = select(sp >= zero4, zero4, select(-sp >= ss, one4, -sp / ss));
+  const vdouble4 t_edge = select(tp >= zero4, zero4, select(-tp >= tt, one4, -tp / tt));
+
+  const vdouble4 denom = ss - 2.0*st + tt;
+
+  // region 0, interior
+  const vdouble4 inv_det = one4 / det;
+  vdouble4 s = s0 * inv_det;
+  vdouble4 t = t0 * inv_det;
+
+  // region 1, edge bc
+  const vdouble4 numer1 = tt + tp - st - sp;
+  const vdouble4 s1 = select(numer1 <= zero4, zero4, select(numer1 >= denom, one4, numer1 / denom));
+  const vbool4 r1 = (!inside) & s_pos & t_pos;
+  s = select(r1, s1, s);
+  t = select(r1, one4 - s1, t);
+
+  // region 2, edge bc or edge ac
+  const vdouble4 tmp1_2 = tt + tp, tmp0_2 = st + sp;
+  const vdouble4 numer2 = tmp1_2 - tmp0_2;
+  const vbool4 bc_2 = tmp1_2 > tmp0_2;
+  const vdouble4 s2 = select(numer2 >= denom, one4, numer2 / denom);
+  const vbool4 r2 = (!inside) & s_neg;
+  s = select(r2, select(bc_2, s2, zero4), s);
+  t = select(r2, select(bc_2, one4 - s2, t_edge), t);
+
+  // region 6, edge bc or edge ab
+  const vdouble4 tmp1_6 = ss + sp, tmp0_6 = st + tp;
+  const vdouble4 numer6 = tmp1_6 - tmp0_6;
+  const vbool4 bc_6 = tmp1_6 > tmp0_6;
+  const vdouble4 t6 = select(numer6 >= denom, one4, numer6 / denom);
+  const vbool4 r6 = (!inside) & s_pos & t_neg;
+  s = select(r6, select(bc_6, one4 - t6, s_edge), s);
+  t = select(r6, select(bc_6, t6, zero4), t);
+
+  // region 3, edge ac
+  const vbool4 r3 = inside & s_neg & t_pos;
+  s = select(r3, zero4, s);
+  t = select(r3, t_edge, t);
+
+  // region 5, edge ab
+  const vbool4 r5 = inside & s_pos & t_neg;
+  s = select(r5, s_edge, s);
+  t = select(r5, zero4, t);
+
+  // region 4, vertex a or either adjacent edge
+  const vbool4 r4 = inside & s_neg & t_neg;
+  const vbool4 ab_4 = sp < zero4;
+  s = select(r4, select(ab_4, s_edge, zero4), s);
+  t = select(r4, select(ab_4, zero4, t_edge), t);
+
+  qx = ax + s*svx + t*tvx;
+  qy = ay + s*svy + t*tvy;
+  qz = az + s*svz + t*tvz;
+
+  const vdouble4 dx = qx - location.x, dy = qy - location.y, dz = qz - location.z;
+  return dx*dx + dy*dy + dz*dz;
+}
+
+#endif
@@ -9,6 +9,8 @@
 #include "moab/GeomUtil.hpp"
 #include "MOABDirectAccessManager.h"
 #include "TriangleIntersectors.h"
+#include "TriangleClosestPoint.h"
+#include "FilterFunc.h"
 #include "sys.h"
 
 struct TriangleRef : public BuildPrimitive {
@@ -118,12 +120,16 @@ struct TriangleRef : public BuildPrimitive {
 template<typename V, typename P, typename I>
   struct __aligned(16) MBTriangleRefT {
 
-  size_t i1, i2, i3;
+  // 32 bit vertex indices leave room for the tag in 32 bytes
+  unsigned int i1, i2, i3;
+  // surface index and sense of the triangle in a flat volume tree,
+  // (index << 1) | sense, 0 for triangles of set trees (see BVH::BuildFlat)
+  unsigned int tag;
   I eh;
 
   __forceinline MBTriangleRefT() {}
 
-  __forceinline MBTriangleRefT(I* conn_ptr, I id) : eh(id) {
+  __forceinline MBTriangleRefT(I* conn_ptr, I id) : tag(0), eh(id) {
     i1 = *(conn_ptr)-1;
     i2 = *(conn_ptr + 1)-1;
     i3 = *(conn_ptr + 2)-1;
@@ -170,7 +176,12 @@ template<typename V, typename P, typename I>
 
   }
 
-  __forceinline bool intersect(const TravRayT<I>& tray, RayT<V,P,I> &ray, void(*ff)(RayT<V,P,I>&, void*), void* mesh_ptr = NULL) {
+  // ff is a filter function or functor, called as ff(ray, mesh_ptr) once
+  // the hit is resolved. It rejects the hit by setting ray.geomID to -1.
+  // With NoFilter only the distance and primitive ID of a closer hit are
+  // written to the ray, the caller resolves the closest one (resolveHit).
+  template<typename F>
+  __forceinline bool intersect(const TravRayT<I>& tray, RayT<V,P,I> &ray, F &ff, void* mesh_ptr = NULL) {
 
 
     if( !mesh_ptr ) MB_CHK_SET_ERR_CONT(moab::MB_FAILURE, "No Mesh Pointer");
@@ -183,13 +194,19 @@ template<typename V, typename P, typename I>
     coords[1] = Vec3da(mdam->xPtr[i2], mdam->yPtr[i2], mdam->zPtr[i2]);
     coords[2] = Vec3da(mdam->xPtr[i3], mdam->yPtr[i3], mdam->zPtr[i3]);
 
+    // resolve the query orientation against the surface sense so that
+    // facets of the wrong orientation are rejected after the first edge test
+    const int orient = tray.sense ? -ray.orientation : ray.orientation;
+
     double dist;
     double huge_val = 1E37;
     bool hit = plucker_ray_tri_intersect(coords,
 					 ray.org,
 					 ray.dir,
 					 dist,
-					 &huge_val);
+					 &huge_val,
+					 NULL,
+					 orient ? &orient : NULL);
 
     /* bool hit = moab::GeomUtil::plucker_ray_tri_intersect(coords, */
     /* 							 origin, */
@@ -203,21 +220,19 @@ template<typename V, typename P, typename I>
     std::cout << std::endl;
 #endif
 
-    if (hit && dist < ray.tfar && dist >= ray.tnear) {
-
-     Vec3da normal = cross((coords[1]-coords[0]),(coords[2]-coords[0]));
-
-     // Vec3da normal(nrm[0], nrm[1], nrm[2]); //cross((coords[1]-coords[0]),(coords[2]-coords[0]));
+    if (hit && dist < ray.tfar && dist >= ray.tnear && !FilterActive<F>::value) {
+      ray.primID = eh;
+      ray.tfar = dist;
+    }
+    else if (hit && dist < ray.tfar && dist >= ray.tnear) {
 
       I pID = ray.primID, gID = ray.geomID;
-      P d = ray.tfar;
-
+      P d = ray.tfar, u = ray.u, v = ray.v;
+      V Ng = ray.Ng;
 
       ray.primID = eh;
       ray.tfar = dist;
-      ray.geomID = tray.setID;
-      ray.Ng = tray.sense? (normal * -1.0) : normal;
-      ray.Ng.normalize();
+      resolveHit(coords, tray.setID, tray.sense, ray);
 
       ff(ray, mesh_ptr);
 
@@ -225,14 +240,84 @@ template<typename V, typename P, typename I>
 	ray.primID = pID;
 	ray.geomID = gID;
 	ray.tfar = d;
+	ray.Ng = Ng;
+	ray.u = u;
+	ray.v = v;
       }
     }
 
     return hit;
   }
 
+  // candidate test for deferred hit evaluation, only the distance and
+  // primitive ID of a closer hit are written to the ray
+  __forceinline bool intersectDeferred(const TravRayT<I>& tray, RayT<V,P,I> &ray, void* mesh_ptr = NULL) const {
+
+    MOABDirectAccessManager* mdam = (MOABDirectAccessManager*) mesh_ptr;
+
+    Vec3da coords[3];
+    get_coords(coords, mdam);
+
+    const int orient = tray.sense ? -ray.orientation : ray.orientation;
+
+    double dist;
+    double huge_val = 1E37;
+    bool hit = plucker_ray_tri_intersect(coords,
+					 ray.org,
+					 ray.dir,
+					 dist,
+					 &huge_val,
+					 NULL,
+					 orient ? &orient : NULL);
+
+    if (hit && dist < ray.tfar && dist >= ray.tnear) {
+      ray.primID = eh;
+      ray.tfar = dist;
+      return true;
+    }
+
+    return false;
+  }
+
+  // fills in the hit attributes for this triangle at distance ray.tfar
+  __forceinline void resolveHit(I setID, int sense, RayT<V,P,I> &ray, void* mesh_ptr = NULL) const {
+
+    if( !mesh_ptr ) MB_CHK_SET_ERR_RET(moab::MB_FAILURE, "No Mesh Pointer");
+
+    MOABDirectAccessManager* mdam = (MOABDirectAccessManager*) mesh_ptr;
+
+    Vec3da coords[3];
+    get_coords(coords, mdam);
+
+    resolveHit(coords, setID, sense, ray);
+  }
+
+  __forceinline void resolveHit(const Vec3da coords[3], I setID, int sense, RayT<V,P,I> &ray) const {
 
-  __forceinline void closestPnt(const TravRayT<I>& tray, RayT<V,P,I> &ray, void* mesh_ptr = NULL) {
+    const Vec3da e1 = coords[1]-coords[0];
+    const Vec3da e2 = coords[2]-coords[0];
+    Vec3da normal = cross(e1, e2);
+
+    ray.geomID = setID;
+    ray.Ng = sense ? (normal * -1.0) : normal;
+    ray.Ng.normalize();
+
+    // barycentric coordinates of the hit point w.r.t. the 2nd and 3rd vertices
+    const Vec3da w = (ray.org + ray.tfar * ray.dir) - coords[0];
+    const double d11 = dot(e1, e1), d12 = dot(e1, e2), d22 = dot(e2, e2);
+    const double dw1 = dot(w, e1), dw2 = dot(w, e2);
+    const double inv_denom = 1.0 / (d11 * d22 - d12 * d12);
+    ray.u = (d22 * dw1 - d12 * dw2) * inv_denom;
+    ray.v = (d11 * dw2 - d12 * dw1) * inv_denom;
+  }
+
+  __forceinline void get_coords(Vec3da coords[3], const MOABDirectAccessManager* mdam) const {
+    coords[0] = Vec3da(mdam->xPtr[i1], mdam->yPtr[i1], mdam->zPtr[i1]);
+    coords[1] = Vec3da(mdam->xPtr[i2], mdam->yPtr[i2], mdam->zPtr[i2]);
+    coords[2] = Vec3da(mdam->xPtr[i3], mdam->yPtr[i3], mdam->zPtr[i3]);
+  }
+
+  __forceinline void closestPnt(const TravRayT<I>& tray, RayT<V,P,I> &ray, void* mesh_ptr = NULL) const {
 
     if( !mesh_ptr ) MB_CHK_SET_ERR_CONT(moab::MB_FAILURE, "No Mesh Pointer");
 
@@ -268,6 +353,83 @@ template<typename V, typename P, typename I>
 
   }
 
+  // closest point query over all triangles of a leaf, evaluated four
+  // triangles per call of the vectorized kernel. Returns the triangle
+  // closer than ray.tfar, if any, with its squared distance and closest
+  // point in dist_sq and pnt for closestPntHit.
+  static __forceinline const MBTriangleRefT* closestPntLeaf(const MBTriangleRefT* prims, size_t num, const RayT<V,P,I> &ray, double &dist_sq, Vec3da &pnt, void* mesh_ptr = NULL) {
+
+    if( !mesh_ptr ) { MB_CHK_SET_ERR_CONT(moab::MB_FAILURE, "No Mesh Pointer"); return NULL; }
+
+    MOABDirectAccessManager* mdam = (MOABDirectAccessManager*) mesh_ptr;
+
+    const Vec3da location(ray.org.x, ray.org.y, ray.org.z);
+
+    double best_dist_sq = ray.tfar * ray.tfar;
+    const MBTriangleRefT* best = NULL;
+
+    for (size_t i = 0; i < num; i += 4) {
+
+      vdouble4 ax, ay, az, bx, by, bz, cx, cy, cz;
+      for (size_t j = 0; j < 4; j++) {
+	// pad the last group with copies of the final triangle
+	const MBTriangleRefT& t = prims[std::min(i+j, num-1)];
+	ax[j] = mdam->xPtr[t.i1]; ay[j] = mdam->yPtr[t.i1]; az[j] = mdam->zPtr[t.i1];
+	bx[j] = mdam->xPtr[t.i2]; by[j] = mdam->yPtr[t.i2]; bz[j] = mdam->zPtr[t.i2];
+	cx[j] = mdam->xPtr[t.i3]; cy[j] = mdam->yPtr[t.i3]; cz[j] = mdam->zPtr[t.i3];
+      }
+
+      vdouble4 qx, qy, qz;
+      const vdouble4 tri_dist_sq = closest_location_on_tri4(location, ax, ay, az, bx, by, bz, cx, cy, cz, qx, qy, qz);
+
+      for (size_t j = 0; j < 4 && i+j < num; j++) {
+	if ( tri_dist_sq[j] < best_dist_sq ) {
+	  best_dist_sq = tri_dist_sq[j];
+	  best = prims + i + j;
+	  pnt = Vec3da(qx[j], qy[j], qz[j]);
+	}
+      }
+    }
+
+    dist_sq = best_dist_sq;
+    return best;
+  }
+
+  // writes the closest point hit on this triangle found by closestPntLeaf
+  // to the ray
+  __forceinline void closestPntHit(const TravRayT<I>& tray, RayT<V,P,I> &ray, double dist_sq, const Vec3da &pnt, void* mesh_ptr = NULL) const {
+
+    if( !mesh_ptr ) MB_CHK_SET_ERR_RET(moab::MB_FAILURE, "No Mesh Pointer");
+
+    MOABDirectAccessManager* mdam = (MOABDirectAccessManager*) mesh_ptr;
+
+    Vec3da coords[3];
+    get_coords(coords, mdam);
+
+    ray.tfar = std::sqrt(dist_sq);
+    ray.primID = eh;
+    ray.geomID = tray.setID;
+
+    Vec3da normal = cross(coords[1]-coords[0], coords[2]-coords[0]);
+    ray.Ng = tray.sense ? (normal * -1.0) : normal;
+    ray.Ng.normalize();
+
+    ray.dir = pnt - Vec3da(ray.org.x, ray.org.y, ray.org.z);
+    ray.dir.normalize();
+  }
+
 };
 
 typedef MBTriangleRefT<Vec3da, double, moab::EntityHandle> MBTriangleRef;
+
+// closest hit recorded by a traversal with deferred hit evaluation, the
+// distance and primitive ID are kept in the ray itself
+template<typename T, typename I>
+struct DeferredHitT {
+
+  __forceinline DeferredHitT() : prim(NULL), setID(0), sense(0) {}
+
+  const T* prim; // triangle in leaf storage
+  I setID;
+  int sense;
+};
@@ -35,7 +35,8 @@ struct Vec3da {
 
   __forceinline Vec3da normalize() { double len = length();
     len = len < min_rcp_input ? min_rcp_input : len;
-    x /= len; y /= len; z/= len; }
+    x /= len; y /= len; z/= len;
+    return *this; }
   
 };
 
@@ -40,7 +40,8 @@ struct __aligned(16) Vec3fa {
 
   __forceinline Vec3fa normalize() { float len = length();
     len = len < min_rcp_input ? min_rcp_input : len;
-    x /= len; y /= len; z/= len; }
+    x /= len; y /= len; z/= len;
+    return *this; }
 
 };
 
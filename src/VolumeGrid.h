@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <cmath>
+
+#include "AABB.h"
+#include "Vec3da.h"
+
+// Uniform grid of cubic cells over the bounding box of a volume, each
+// cell labelled as inside or outside the volume if the boundary does not
+// pass through it, or as a boundary cell otherwise. Inside and outside
+// cells also hold a lower bound on the distance from any point in the
+// cell to the boundary, so queries for points in them need no traversal.
+class VolumeGrid {
+
+ public:
+
+  enum CellLabel { CELL_BOUNDARY = 0, CELL_INSIDE = 1, CELL_OUTSIDE = 2 };
+
+  // memory used per cell
+  static const size_t bytesPerCell = sizeof(unsigned char) + sizeof(float);
+
+  inline VolumeGrid() : width(0.0) {
+    for (size_t i = 0; i < 3; i++) { lower[i] = 0.0; dims[i] = 0; }
+  }
+
+  // Lay out cells over box with resolution cells along its longest side,
+  // fewer if they would take more than maxBytes. A side of zero length
+  // gets one layer of cells. All cells start out as boundary cells.
+  // Returns false if not even one cell fits or the box is empty, a point
+  // or not finite.
+  inline bool setup(const AABB &box, size_t resolution, size_t maxBytes) {
+    double extent[3];
+    for (size_t i = 0; i < 3; i++) {
+      lower[i] = box.lower[i];
+      extent[i] = box.upper[i] - box.lower[i];
+    }
+    const double longest = std::max(extent[0], std::max(extent[1], extent[2]));
+
+    // no cell width to derive from the box
+    if (!(longest > 0.0) || !std::isfinite(longest)) resolution = 0;
+
+    for (; resolution > 0; resolution--) {
+      width = longest / resolution;
+      size_t num = 1;
+      for (size_t i = 0; i < 3; i++) {
+	dims[i] = std::max((size_t)ceil(extent[i] / width), (size_t)1);
+	num *= dims[i];
+      }
+      if (num * bytesPerCell <= maxBytes) break;
+    }
+    if (resolution == 0) { dims[0] = dims[1] = dims[2] = 0; }
+
+    labels.assign(size(), (unsigned char)CELL_BOUNDARY);
+    bounds.assign(size(), 0.0f);
+    return !labels.empty();
+  }
+
+  inline size_t size() const { return dims[0]*dims[1]*dims[2]; }
+
+  inline bool empty() const { return labels.empty(); }
+
+  // the cell containing point, false if the point is outside the grid
+  inline bool cell(const Vec3da &point, size_t &c) const {
+    size_t idx[3];
+    for (size_t i = 0; i < 3; i++) {
+      const double t = (point[i] - lower[i]) / width;
+      if (!(t >= 0.0) || t >= dims[i]) return false;
+      idx[i] = (size_t)t;
+    }
+    c = (idx[2]*dims[1] + idx[1])*dims[0] + idx[0];
+    return true;
+  }
+
+  inline Vec3da center(size_t c) const {
+    const size_t ix = c % dims[0], iy = (c / dims[0]) % dims[1], iz = c / (dims[0]*dims[1]);
+    return Vec3da(lower[0] + (ix + 0.5)*width, lower[1] + (iy + 0.5)*width, lower[2] + (iz + 0.5)*width);
+  }
+
+  // distance from the center of a cell to its corners
+  inline double halfDiagonal() const { return 0.5*sqrt(3.0)*width; }
+
+  inline void set(size_t c, CellLabel label, float bound) {
+    labels[c] = (unsigned char)label;
+    bounds[c] = bound;
+  }
+
+  inline CellLabel label(size_t c) const { return (CellLabel)labels[c]; }
+
+  inline float bound(size_t c) const { return bounds[c]; }
+
+ private:
+  // not a Vec3da, grids live in std::map nodes which need not be 32 byte aligned
+  double lower[3];
+  double width;
+  size_t dims[3];
+  std::vector<unsigned char> labels;
+  std::vector<float> bounds;
+
+};
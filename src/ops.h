@@ -20,4 +20,12 @@ __forceinline size_t __bscf(size_t& v) {
   return i;
 }
 
+__forceinline size_t __popcnt(size_t v) {
+#if defined(__POPCNT__)
+  return _mm_popcnt_u64(v);
+#else
+  return __builtin_popcountll(v);
+#endif
+}
+
 #endif
@@ -19,9 +19,9 @@ struct vbool4
   __forceinline vbool4 (const vbool4& other) { b[0] = other.b[0];
                                         b[1] = other.b[1];
 					b[2] = other.b[2];
-					b[3] = other.b[2]; }
+					b[3] = other.b[3]; }
 
-  __forceinline vbool4& operator =( const bool& a ) { b[0] = a; b[1] = a; b[2] = a; b[3] = a; }
+  __forceinline vbool4& operator =( const bool& a ) { b[0] = a; b[1] = a; b[2] = a; b[3] = a; return *this; }
     
   __forceinline vbool4( bool a )                        { b[0] = a; b[1] = a; b[2] = a; b[3] = a; }
   __forceinline vbool4( bool i, bool j, bool k, bool l) { b[0] = i; b[1] = j; b[2] = k; b[3] = l; }
@@ -46,6 +46,11 @@ __forceinline const size_t movemask( const vbool4& v ) { return sgn(v.b[3]) << 3
 
 __forceinline bool all( const vbool4& v ) { return v.b[0] && v.b[1] && v.b[2] && v.b[3]; }
 
+////////// Logical Ops //////////
+__forceinline const vbool4 operator !( const vbool4& a ) { return vbool4(!a.b[0], !a.b[1], !a.b[2], !a.b[3]); }
+__forceinline const vbool4 operator &( const vbool4& a, const vbool4& b ) { return vbool4(a.b[0] && b.b[0], a.b[1] && b.b[1], a.b[2] && b.b[2], a.b[3] && b.b[3]); }
+__forceinline const vbool4 operator |( const vbool4& a, const vbool4& b ) { return vbool4(a.b[0] || b.b[0], a.b[1] || b.b[1], a.b[2] || b.b[2], a.b[3] || b.b[3]); }
+
 /* ////////// Unary Ops ////////// */
 /* __forceinline const vbool4 operator +( const vbool4& a ) { return a; } */
 /* __forceinline const vbool4 operator -( const vbool4& a ) { return vbool4(-a[0],-a[1],-a[2],-a[3]); } */
@@ -20,7 +20,7 @@ struct vdouble4
 					  f[2] = other.f[2];
 					  f[3] = other.f[3]; }
 
-  __forceinline vdouble4& operator =( const double& a ) { f[0] = a; f[1] = a; f[2] = a; f[3] = a; }
+  __forceinline vdouble4& operator =( const double& a ) { f[0] = a; f[1] = a; f[2] = a; f[3] = a; return *this; }
 
   __forceinline vdouble4( double a )                            { f[0] = a; f[1] = a; f[2] = a; f[3] = a; }
   __forceinline vdouble4( double a, double b, double c, double d) {  f[0] = a; f[1] = b; f[2] = c; f[3] = d; }
@@ -106,6 +106,11 @@ __forceinline const vbool4 operator <=( const vdouble4& a, const vdouble4&b ) {
 										     a.f[3]<=b.f[3]); }
 
 ////////// Other Common Ops //////////
+__forceinline const vdouble4 select( const vbool4& m, const vdouble4& t, const vdouble4& f ) { return vdouble4(m.b[0] ? t.f[0] : f.f[0],
+												      m.b[1] ? t.f[1] : f.f[1],
+												      m.b[2] ? t.f[2] : f.f[2],
+												      m.b[3] ? t.f[3] : f.f[3]); }
+
 __forceinline const vdouble4 madd  ( const vdouble4& a, const vdouble4& b, const vdouble4& c) { return a*b+c; }
 __forceinline const vdouble4 msub  ( const vdouble4& a, const vdouble4& b, const vdouble4& c) { return a*b-c; }
 __forceinline const vdouble4 nmadd ( const vdouble4& a, const vdouble4& b, const vdouble4& c) { return -a*b+c;}
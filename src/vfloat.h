@@ -27,7 +27,7 @@ struct vfloat4
 					  f[2] = other.f[2];
 					  f[3] = other.f[3]; }
 
-  __forceinline vfloat4& operator =( const float& a ) { f[0] = a; f[1] = a; f[2] = a; f[3] = a; }
+  __forceinline vfloat4& operator =( const float& a ) { f[0] = a; f[1] = a; f[2] = a; f[3] = a; return *this; }
 
   __forceinline vfloat4( float a )                            { f[0] = a; f[1] = a; f[2] = a; f[3] = a; }
   __forceinline vfloat4( float a, float b, float c, float d) {  f[0] = a; f[1] = b; f[2] = c; f[3] = d; }
@@ -28,7 +28,7 @@ struct vint4
 					  f[2] = other.f[2];
 					  f[3] = other.f[3]; }
 
-  __forceinline vint4& operator =( const int& a ) { f[0] = a; f[1] = a; f[2] = a; f[3] = a; }
+  __forceinline vint4& operator =( const int& a ) { f[0] = a; f[1] = a; f[2] = a; f[3] = a; return *this; }
 
   __forceinline vint4( int a )                            { f[0] = a; f[1] = a; f[2] = a; f[3] = a; }
   __forceinline vint4( int a, int b, int c, int d) {  f[0] = a; f[1] = b; f[2] = c; f[3] = d; }
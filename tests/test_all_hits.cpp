@@ -0,0 +1,171 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#define NUM_RAYS 2000
+
+// every candidate hit seen by the filter, which rejects them all
+std::vector<MBRayHit> candidates;
+
+void collect_hits(MBRay &ray, void*) {
+  MBRayHit hit;
+  hit.dist = ray.tfar;
+  hit.primID = ray.primID;
+  hit.setID = ray.geomID;
+  hit.sense = 0;
+  candidates.push_back(hit);
+  ray.geomID = -1;
+  ray.primID = -1;
+}
+
+bool hit_dist_less(const MBRayHit& a, const MBRayHit& b) { return a.dist < b.dist; }
+
+// candidates sorted by distance without repeated hits on a surface
+std::vector<MBRayHit> unique_candidates(double tol) {
+  std::vector<MBRayHit> hits = candidates;
+  std::stable_sort(hits.begin(), hits.end(), hit_dist_less);
+  std::vector<MBRayHit> unique;
+  for(size_t i = 0; i < hits.size(); i++) {
+    bool dup = false;
+    for(size_t j = 0; j < unique.size(); j++) {
+      if(unique[j].setID == hits[i].setID && hits[i].dist - unique[j].dist <= tol) dup = true;
+    }
+    if(!dup) unique.push_back(hits[i]);
+  }
+  return unique;
+}
+
+void test_cube_crossing() {
+  TestModel model(TEST_CUBE);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  // passes through the center of two faces, on the diagonal edge
+  // shared by the two triangles of each face
+  MBRay ray(Vec3da(-10.0, 0.0, 0.0), Vec3da(1.0, 0.0, 0.0));
+  ray.instID = vols[0];
+
+  std::vector<MBRayHit> hits;
+  rval = MBVHM.fireRayAllHits(ray, hits);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+
+  CHECK_EQUAL((size_t)2, hits.size());
+  CHECK_REAL_EQUAL(5.0, hits[0].dist, 1e-12);
+  CHECK_REAL_EQUAL(15.0, hits[1].dist, 1e-12);
+  CHECK(hits[0].setID != hits[1].setID);
+
+  // the ray itself is left alone
+  CHECK_EQUAL((moab::EntityHandle)-1, ray.primID);
+  CHECK(ray.tfar == (double)inf);
+
+  // surface and sense match those of the closest hit
+  MBRay closest = ray;
+  rval = MBVHM.fireRay(closest);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  CHECK_EQUAL(closest.geomID, hits[0].setID);
+  // the surfaces of the cube face out of its volume
+  CHECK_EQUAL(0, hits[0].sense);
+  CHECK(dot(closest.Ng, ray.dir) < 0.0);
+
+  // the nearest hit only
+  MBRayHit nearest;
+  size_t num_hits;
+  rval = MBVHM.fireRayAllHits(ray, &nearest, 1, num_hits);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  CHECK_EQUAL((size_t)1, num_hits);
+  CHECK_REAL_EQUAL(5.0, nearest.dist, 1e-12);
+
+  // hits on the segment only
+  ray.tnear = 6.0;
+  rval = MBVHM.fireRayAllHits(ray, hits);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  CHECK_EQUAL((size_t)1, hits.size());
+  CHECK_REAL_EQUAL(15.0, hits[0].dist, 1e-12);
+}
+
+// compare multi-hit queries to the hits collected by a filter
+void compare_all_hits(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  const double tol = MBVHM.MOABBVH->duplicate_hit_tolerance();
+
+  size_t max_hits = 0;
+  for(size_t j = 0; j < NUM_RAYS; j++) {
+    MBRay ray(random_vec(extent), random_dir());
+    ray.instID = vols[j % vols.size()];
+    if (j % 3 == 0) ray.tfar = 2.0*extent*rand()/RAND_MAX;
+
+    candidates.clear();
+    std::vector<MBRayHit> hits;
+    MBVHM.MOABBVH->set_filter(collect_hits);
+    rval = MBVHM.fireRayAllHits(ray, hits);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+    MBVHM.MOABBVH->unset_filter();
+    // all hits rejected by the filter
+    CHECK_EQUAL((size_t)0, hits.size());
+
+    std::vector<MBRayHit> expected = unique_candidates(tol);
+
+    rval = MBVHM.fireRayAllHits(ray, hits);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+
+    CHECK_EQUAL(expected.size(), hits.size());
+    for(size_t i = 0; i < hits.size(); i++) {
+      CHECK_REAL_EQUAL(expected[i].dist, hits[i].dist, 0.0);
+      CHECK_EQUAL(expected[i].setID, hits[i].setID);
+      if (i > 0) CHECK(hits[i].dist >= hits[i-1].dist);
+      CHECK(hits[i].dist >= ray.tnear && hits[i].dist < ray.tfar);
+    }
+    max_hits = std::max(max_hits, hits.size());
+
+    // the first hit is the closest one
+    MBRay closest = ray;
+    rval = MBVHM.fireRay(closest);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+    if (hits.size()) { CHECK_REAL_EQUAL(closest.tfar, hits[0].dist, 0.0); }
+    else { CHECK_EQUAL((moab::EntityHandle)-1, closest.primID); }
+
+    // the k nearest hits are the first k of all hits
+    for(size_t k = 1; k < hits.size(); k++) {
+      std::vector<MBRayHit> nearest(k);
+      size_t num_hits;
+      rval = MBVHM.fireRayAllHits(ray, &nearest[0], k, num_hits);
+      MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+      CHECK_EQUAL(k, num_hits);
+      for(size_t i = 0; i < k; i++) {
+	CHECK_REAL_EQUAL(hits[i].dist, nearest[i].dist, 0.0);
+      }
+    }
+  }
+  CHECK(max_hits > 1);
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  test_cube_crossing();
+
+  compare_all_hits(TEST_CUBE, 10.0);
+  compare_all_hits(TEST_CUBE_CYLINDER, 10.0);
+  compare_all_hits(TEST_SMALL_SPHERE, 20.0);
+
+  return 0;
+}
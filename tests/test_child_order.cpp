@@ -0,0 +1,69 @@
+
+#include <stdlib.h>
+
+#include "testutil.hpp"
+#include "Stack.h"
+#include "Node.h"
+#include "Traverser.h"
+
+void test_child_order(const vfloat4& tNear);
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  // distinct distances
+  test_child_order(vfloat4(4.0f, 1.0f, 3.0f, 2.0f));
+
+  // ties and zero distances
+  test_child_order(vfloat4(1.0f, 1.0f, 0.0f, 0.0f));
+
+  for(size_t i = 0; i < 1000; i++) {
+    vfloat4 tNear;
+    for(size_t j = 0; j < 4; j++) tNear[j] = 100.0f * rand() / RAND_MAX;
+    test_child_order(tNear);
+  }
+
+  return 0;
+}
+
+// compare the node order of the SIMD traversal to the original for all hit masks
+void test_child_order(const vfloat4& tNear) {
+
+  AANode node;
+  for(size_t i = 0; i < NARY; i++) node.children[i] = NodeRef(64*(i+1));
+
+  for(size_t mask = 1; mask < 16; mask++) {
+
+    StackItemT<NodeRef> stack[8], simd_stack[8];
+
+    NodeRef cur((size_t)&node), simd_cur((size_t)&node);
+    StackItemT<NodeRef>* stackPtr = stack;
+    StackItemT<NodeRef>* simdStackPtr = simd_stack;
+
+    BVHTraverser::traverseClosest(cur, mask, tNear, stackPtr, stack+8);
+    BVHTraverser::traverseClosestSIMD(simd_cur, mask, tNear, simdStackPtr, simd_stack+8);
+
+    // the same number of children are left on the stack
+    CHECK_EQUAL(stackPtr - stack, simdStackPtr - simd_stack);
+
+    // the nearest child is traversed next, ties can go either way
+    float d = ((float*)&tNear)[(cur.pointer()/64) - 1];
+    float simd_d = ((float*)&tNear)[(simd_cur.pointer()/64) - 1];
+    CHECK_REAL_EQUAL(d, simd_d, 0.0f);
+    CHECK(mask & (1 << ((simd_cur.pointer()/64) - 1)));
+
+    // stack entries are farthest first, distances are never increased
+    for(StackItemT<NodeRef>* s = simd_stack; s != simdStackPtr; s++) {
+      size_t child = (s->ptr.pointer()/64) - 1;
+      CHECK(mask & (1 << child));
+      CHECK(s->ptr.pointer() != simd_cur.pointer());
+      float exact = ((float*)&tNear)[child];
+      float stored = *(float*)&(s->dist);
+      CHECK(stored <= exact);
+      CHECK(exact >= simd_d);
+      if(s != simd_stack) CHECK(*(float*)&((s-1)->dist) >= stored);
+    }
+  }
+
+}
@@ -0,0 +1,81 @@
+
+#include "testutil.hpp"
+
+#include "moab/Core.hpp"
+#include "moab/CartVect.hpp"
+#include "moab/GeomUtil.hpp"
+
+#include "TriangleClosestPoint.h"
+
+#include <cstdlib>
+
+#define NUM_TRIS 10000
+#define NUM_PNTS 20
+#define EPS 1e-10
+
+double rand_val(double lo, double hi) { return lo + (hi-lo)*double(rand())/double(RAND_MAX); }
+
+moab::CartVect rand_pnt(double lo, double hi) { return moab::CartVect(rand_val(lo, hi), rand_val(lo, hi), rand_val(lo, hi)); }
+
+// compares closest_location_on_tri4 with moab::GeomUtil for four triangles and one location
+void check_tris(const moab::CartVect tris[4][3], const moab::CartVect& location) {
+
+  vdouble4 ax, ay, az, bx, by, bz, cx, cy, cz;
+  for(size_t i = 0; i < 4; i++) {
+    ax[i] = tris[i][0][0]; ay[i] = tris[i][0][1]; az[i] = tris[i][0][2];
+    bx[i] = tris[i][1][0]; by[i] = tris[i][1][1]; bz[i] = tris[i][1][2];
+    cx[i] = tris[i][2][0]; cy[i] = tris[i][2][1]; cz[i] = tris[i][2][2];
+  }
+
+  vdouble4 qx, qy, qz;
+  Vec3da loc(location[0], location[1], location[2]);
+  vdouble4 dist_sq = closest_location_on_tri4(loc, ax, ay, az, bx, by, bz, cx, cy, cz, qx, qy, qz);
+
+  for(size_t i = 0; i < 4; i++) {
+    moab::CartVect expected;
+    moab::GeomUtil::closest_location_on_tri(location, tris[i], expected);
+
+    CHECK_REAL_EQUAL(expected[0], qx[i], EPS);
+    CHECK_REAL_EQUAL(expected[1], qy[i], EPS);
+    CHECK_REAL_EQUAL(expected[2], qz[i], EPS);
+    CHECK_REAL_EQUAL((expected - location).length_squared(), dist_sq[i], EPS);
+  }
+}
+
+int main(int argc, char** argv) {
+
+  srand(13);
+
+  moab::CartVect tris[4][3];
+
+  // random triangles with locations all around them so that every
+  // vertex, edge and interior region is exercised
+  for(size_t n = 0; n < NUM_TRIS; n++) {
+    for(size_t i = 0; i < 4; i++) {
+      for(size_t j = 0; j < 3; j++) tris[i][j] = rand_pnt(-1.0, 1.0);
+    }
+    for(size_t k = 0; k < NUM_PNTS; k++) check_tris(tris, rand_pnt(-3.0, 3.0));
+  }
+
+  // locations on the triangle vertices, edges and plane
+  for(size_t n = 0; n < NUM_TRIS; n++) {
+    for(size_t i = 0; i < 4; i++) {
+      for(size_t j = 0; j < 3; j++) tris[i][j] = rand_pnt(-1.0, 1.0);
+    }
+    check_tris(tris, tris[0][0]);
+    check_tris(tris, 0.5*(tris[1][1] + tris[1][2]));
+    check_tris(tris, (tris[2][0] + tris[2][1] + tris[2][2])/3.0);
+  }
+
+  // long, thin triangles
+  for(size_t n = 0; n < NUM_TRIS; n++) {
+    for(size_t i = 0; i < 4; i++) {
+      tris[i][0] = rand_pnt(-1.0, 1.0);
+      tris[i][1] = tris[i][0] + 100.0*rand_pnt(-1.0, 1.0);
+      tris[i][2] = tris[i][0] + 1e-03*rand_pnt(-1.0, 1.0);
+    }
+    for(size_t k = 0; k < NUM_PNTS; k++) check_tris(tris, rand_pnt(-50.0, 50.0));
+  }
+
+  return 0;
+}
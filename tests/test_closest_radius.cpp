@@ -0,0 +1,75 @@
+
+#include "testutil.hpp"
+#include "test_files.h"
+
+#include "MBVHManager.h"
+#include "moab/Core.hpp"
+
+void closest(MBVHManager* BVH, moab::EntityHandle vol, const Vec3da& org, double radius, MBRay& ray) {
+  ray = MBRay(org, Vec3da(0.0, 0.0, 0.0), 0.0, radius);
+  ray.instID = vol;
+  moab::ErrorCode rval = BVH->closestToLocation(ray);
+  MB_CHK_SET_ERR_RET(rval, "Failed to find closest location");
+}
+
+int main(int argc, char** argv) {
+
+  moab::ErrorCode rval = moab::MB_SUCCESS;
+
+  moab::Interface* MBI = new moab::Core();
+
+  rval = MBI->load_file(TEST_CUBE);
+  MB_CHK_SET_ERR(rval, "Failed to load the test file");
+
+  MBVHManager* BVH = new MBVHManager(MBI);
+  rval = BVH->build_all();
+  MB_CHK_SET_ERR(rval, "Failed to build tree(2) for the model");
+
+  moab::Tag geom_dim_tag;
+  rval = MBI->tag_get_handle(GEOM_DIMENSION_TAG_NAME, geom_dim_tag);
+  MB_CHK_SET_ERR(rval, "Failed to get the geom dim tag handle");
+
+  moab::Range vols;
+  int dim = 3;
+  void *ptr = &dim;
+  rval = MBI->get_entities_by_type_and_tag(0, moab::MBENTITYSET, &geom_dim_tag, &ptr, 1, vols);
+  MB_CHK_SET_ERR(rval, "Failed to retrieve volume entitysets");
+
+  CHECK_EQUAL(1, (int)vols.size());
+
+  MBRay ray;
+
+  // center of the cube is 5 units from every face
+  Vec3da org(0.0, 0.0, 0.0);
+
+  closest(BVH, vols[0], org, inf, ray);
+  CHECK_REAL_EQUAL(5.0, ray.tfar, 1e-12);
+  CHECK(ray.primID != (moab::EntityHandle)-1);
+
+  closest(BVH, vols[0], org, 6.0, ray);
+  CHECK_REAL_EQUAL(5.0, ray.tfar, 1e-12);
+  CHECK(ray.primID != (moab::EntityHandle)-1);
+
+  // nothing within the search radius
+  closest(BVH, vols[0], org, 4.0, ray);
+  CHECK_REAL_EQUAL(4.0, ray.tfar, 0.0);
+  CHECK_EQUAL((moab::EntityHandle)-1, ray.primID);
+
+  // outside of the cube, nearest the +x face
+  org = Vec3da(8.0, 1.0, -2.0);
+
+  closest(BVH, vols[0], org, inf, ray);
+  CHECK_REAL_EQUAL(3.0, ray.tfar, 1e-12);
+  CHECK_REAL_EQUAL(-1.0, ray.dir[0], 1e-12);
+
+  closest(BVH, vols[0], org, 2.5, ray);
+  CHECK_EQUAL((moab::EntityHandle)-1, ray.primID);
+
+  // off the corner of the cube
+  org = Vec3da(6.0, 6.0, 6.0);
+
+  closest(BVH, vols[0], org, inf, ray);
+  CHECK_REAL_EQUAL(sqrt(3.0), ray.tfar, 1e-12);
+
+  return rval;
+}
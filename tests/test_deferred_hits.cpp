@@ -0,0 +1,82 @@
+
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_RAYS 1000
+
+// accepts every hit, each candidate is resolved as it is found so that
+// the filter sees it
+struct AcceptAll {
+  void operator()(MBRay &ray, void*) {}
+};
+
+int main(int argc, char** argv) {
+
+  TestModel model(TEST_CUBE_CYLINDER);
+  MB_CHK_SET_ERR(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+  moab::Interface* mbi = model.mbi;
+
+  moab::ErrorCode rval = moab::MB_SUCCESS;
+
+  srand(42);
+
+  for(moab::Range::iterator i = vols.begin(); i != vols.end(); i++) {
+    for(size_t j = 0; j < NUM_RAYS; j++) {
+
+      Vec3da org(0.0, 0.0, 0.0), dir = random_dir();
+
+      AcceptAll accept;
+      MBRay eager(org, dir);
+      eager.instID = *i;
+      rval = MBVHM.fireRay(eager, accept);
+      MB_CHK_SET_ERR(rval, "Failed to fire ray");
+
+      MBRay deferred(org, dir);
+      deferred.instID = *i;
+      rval = MBVHM.fireRay(deferred);
+      MB_CHK_SET_ERR(rval, "Failed to fire ray");
+
+      if ( eager.tfar == (double)inf ) {
+	CHECK(deferred.tfar == (double)inf);
+	continue;
+      }
+
+      CHECK_REAL_EQUAL(eager.tfar, deferred.tfar, 0.0);
+      CHECK_EQUAL(eager.primID, deferred.primID);
+      CHECK_EQUAL(eager.geomID, deferred.geomID);
+      CHECK_REAL_EQUAL(eager.Ng[0], deferred.Ng[0], 0.0);
+      CHECK_REAL_EQUAL(eager.Ng[1], deferred.Ng[1], 0.0);
+      CHECK_REAL_EQUAL(eager.Ng[2], deferred.Ng[2], 0.0);
+      CHECK_REAL_EQUAL(eager.u, deferred.u, 0.0);
+      CHECK_REAL_EQUAL(eager.v, deferred.v, 0.0);
+
+      // barycentric coordinates should recover the hit location
+      std::vector<moab::EntityHandle> conn;
+      rval = mbi->get_connectivity(&deferred.primID, 1, conn);
+      MB_CHK_SET_ERR(rval, "Failed to get triangle connectivity");
+
+      moab::CartVect coords[3];
+      rval = mbi->get_coords(&conn[0], 3, coords[0].array());
+      MB_CHK_SET_ERR(rval, "Failed to get triangle coordinates");
+
+      moab::CartVect hit_pnt = (1.0 - deferred.u - deferred.v) * coords[0] + deferred.u * coords[1] + deferred.v * coords[2];
+      Vec3da expected = org + deferred.tfar * dir;
+
+      CHECK(deferred.u >= -1e-06 && deferred.v >= -1e-06 && deferred.u + deferred.v <= 1.0 + 1e-06);
+      CHECK_REAL_EQUAL(expected[0], hit_pnt[0], 1e-06);
+      CHECK_REAL_EQUAL(expected[1], hit_pnt[1], 1e-06);
+      CHECK_REAL_EQUAL(expected[2], hit_pnt[2], 1e-06);
+    }
+  }
+
+  return rval;
+}
@@ -0,0 +1,65 @@
+
+#include "testutil.hpp"
+#include "test_files.h"
+
+#include "MBVHManager.h"
+#include "diffutil.hpp"
+#include "moab/Core.hpp"
+
+#include <iostream>
+
+// number of queries of each kind per volume
+static const size_t NUM_QUERIES = 2000;
+
+void differential(const char* filename, size_t num_queries, ChildOrder order = CHILD_ORDER_DISTANCE) {
+
+  moab::ErrorCode rval;
+
+  moab::Interface* MBI = new moab::Core();
+
+  rval = MBI->load_file(filename);
+  MB_CHK_SET_ERR_RET(rval, "Failed to load the test file");
+
+  MBVHManager* BVH = new MBVHManager(MBI);
+  rval = BVH->build_all();
+  MB_CHK_SET_ERR_RET(rval, "Failed to build trees for the model");
+
+  BVH->MOABBVH->set_child_order(order);
+
+  moab::Tag geom_dim_tag;
+  rval = MBI->tag_get_handle(GEOM_DIMENSION_TAG_NAME, geom_dim_tag);
+  MB_CHK_SET_ERR_RET(rval, "Failed to get the geom dim tag handle");
+
+  moab::Range vols;
+  int dim = 3;
+  void *ptr = &dim;
+  rval = MBI->get_entities_by_type_and_tag(0, moab::MBENTITYSET, &geom_dim_tag, &ptr, 1, vols);
+  MB_CHK_SET_ERR_RET(rval, "Failed to retrieve volume entitysets");
+
+  DiffHarness harness(MBI, BVH);
+
+  for(moab::Range::iterator i = vols.begin(); i != vols.end(); i++) {
+    rval = harness.run_all(*i, num_queries);
+    MB_CHK_SET_ERR_RET(rval, "Failed differential run");
+  }
+
+  std::cout << filename << std::endl;
+  harness.report(std::cout);
+
+  CHECK_EQUAL((size_t)0, harness.mismatches());
+
+  delete BVH;
+  delete MBI;
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  differential(TEST_CUBE, NUM_QUERIES);
+  differential(TEST_CUBE_CYLINDER, NUM_QUERIES);
+  differential(TEST_CUBE_CYLINDER, NUM_QUERIES, CHILD_ORDER_DISTANCE_SIMD);
+  differential(TEST_SMALL_SPHERE, NUM_QUERIES/10);
+
+  return 0;
+}
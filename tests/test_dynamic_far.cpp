@@ -0,0 +1,77 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_RAYS 10000
+
+// compare traversals with and without the dynamic far distance, which
+// must find the same hits while doing no more work
+void compare_far(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<MBRay> rays;
+
+  for(size_t j = 0; j < NUM_RAYS; j++) {
+    MBRay ray = random_ray(vols, j, extent);
+    rays.push_back(ray);
+  }
+
+  std::vector<MBRay> dynamic_rays = rays, static_rays = rays;
+  TraversalStats dynamic_stats, static_stats;
+
+  CHECK(MBVHM.MOABBVH->dynamic_far());
+  MBVHM.MOABBVH->set_traversal_stats(&dynamic_stats);
+  for(size_t j = 0; j < rays.size(); j++) {
+    rval = MBVHM.fireRay(dynamic_rays[j]);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  }
+
+  MBVHM.MOABBVH->set_dynamic_far(false);
+  MBVHM.MOABBVH->set_traversal_stats(&static_stats);
+  for(size_t j = 0; j < rays.size(); j++) {
+    rval = MBVHM.fireRay(static_rays[j]);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  }
+
+  MBVHM.MOABBVH->set_traversal_stats(NULL);
+  MBVHM.MOABBVH->set_dynamic_far(true);
+
+  for(size_t j = 0; j < rays.size(); j++) check_same_hit(static_rays[j], dynamic_rays[j]);
+
+  CHECK_EQUAL((unsigned long long)NUM_RAYS, dynamic_stats.rays);
+  CHECK_EQUAL((unsigned long long)NUM_RAYS, static_stats.rays);
+  CHECK(dynamic_stats.nodes > 0);
+  CHECK(dynamic_stats.triangles >= dynamic_stats.leaves);
+  CHECK(dynamic_stats.nodes <= static_stats.nodes);
+  CHECK(dynamic_stats.boxes <= static_stats.boxes);
+  CHECK(dynamic_stats.triangles <= static_stats.triangles);
+
+  // nothing is counted once the tracker is removed
+  TraversalStats before = dynamic_stats;
+  rval = MBVHM.fireRay(rays[0]);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  CHECK_EQUAL(before.rays, dynamic_stats.rays);
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  compare_far(TEST_CUBE, 10.0);
+  compare_far(TEST_CUBE_CYLINDER, 10.0);
+  compare_far(TEST_SMALL_SPHERE, 2.0);
+
+  return 0;
+}
@@ -0,0 +1,158 @@
+#include "testutil.hpp"
+#include "test_files.h"
+
+#include "MBVHManager.h"
+#include "moab/Core.hpp"
+
+void backface_cull(MBRay &ray, void*) {
+  if(dot(ray.dir, ray.Ng) < 0.0) {
+    ray.geomID = -1;
+    ray.primID = -1;
+  }
+}
+
+// the same culling as a functor, counting the hits it sees
+struct BackfaceCull {
+  BackfaceCull() : calls(0) {}
+
+  void operator()(MBRay &ray, void*) {
+    calls++;
+    backface_cull(ray, NULL);
+  }
+
+  int calls;
+};
+
+// rejects hits on one surface
+struct SkipSurface {
+  SkipSurface(moab::EntityHandle surf) : surf(surf) {}
+
+  void operator()(MBRay &ray, void*) {
+    if(ray.geomID == surf) {
+      ray.geomID = -1;
+      ray.primID = -1;
+    }
+  }
+
+  moab::EntityHandle surf;
+};
+
+MBRay make_ray(moab::EntityHandle vol, const Vec3da& org, const Vec3da& dir) {
+  MBRay ray(org, dir);
+  ray.instID = vol;
+  return ray;
+}
+
+int main(int argc, char** argv) {
+
+  moab::ErrorCode rval = moab::MB_SUCCESS;
+
+  moab::Interface* MBI = new moab::Core();
+
+  rval = MBI->load_file(TEST_CUBE);
+  MB_CHK_SET_ERR(rval, "Failed to load the test file");
+
+  MBVHManager* BVH = new MBVHManager(MBI);
+  rval = BVH->build_all();
+  MB_CHK_SET_ERR(rval, "Failed to build tree(2) for the model");
+
+  moab::Tag geom_dim_tag;
+  rval = MBI->tag_get_handle(GEOM_DIMENSION_TAG_NAME, geom_dim_tag);
+  MB_CHK_SET_ERR(rval, "Failed to get the geom dim tag handle");
+
+  moab::Range vols;
+  int dim = 3;
+  void *ptr = &dim;
+  rval = MBI->get_entities_by_type_and_tag(0, moab::MBENTITYSET, &geom_dim_tag, &ptr, 1, vols);
+  MB_CHK_SET_ERR(rval, "Failed to retrieve volume entitysets");
+
+  CHECK_EQUAL(1, (int)vols.size());
+
+  // ray from outside the cube: enters at x = -5, exits at x = 5
+  const Vec3da org(-10.0, 0.1, 0.2), dir(1.0, 0.0, 0.0);
+
+  // no filter, same result as the unfiltered query
+  MBRay plain = make_ray(vols[0], org, dir);
+  rval = BVH->fireRay(plain);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  CHECK_REAL_EQUAL(5.0, plain.tfar, 1e-12);
+
+  NoFilter no_filter;
+  MBRay ray = make_ray(vols[0], org, dir);
+  rval = BVH->fireRay(ray, no_filter);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  CHECK_REAL_EQUAL(plain.tfar, ray.tfar, 0.0);
+  CHECK_EQUAL(plain.primID, ray.primID);
+  CHECK_EQUAL(plain.geomID, ray.geomID);
+  CHECK_REAL_EQUAL(plain.Ng[0], ray.Ng[0], 0.0);
+
+  // a functor matches the same filter set on the tree
+  BackfaceCull cull;
+  ray = make_ray(vols[0], org, dir);
+  rval = BVH->fireRay(ray, cull);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  CHECK_REAL_EQUAL(15.0, ray.tfar, 1e-12);
+  CHECK(cull.calls >= 2);
+
+  BVH->MOABBVH->set_filter(backface_cull);
+  MBRay tree_filtered = make_ray(vols[0], org, dir);
+  rval = BVH->fireRay(tree_filtered);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  BVH->MOABBVH->unset_filter();
+  CHECK_REAL_EQUAL(tree_filtered.tfar, ray.tfar, 0.0);
+  CHECK_EQUAL(tree_filtered.primID, ray.primID);
+
+  // the filter of the tree is left alone by functor queries
+  ray = make_ray(vols[0], org, dir);
+  rval = BVH->fireRay(ray);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  CHECK_REAL_EQUAL(5.0, ray.tfar, 1e-12);
+
+  // functor state is per call
+  SkipSurface skip_entry(plain.geomID);
+  SkipSurface skip_other(0);
+  ray = make_ray(vols[0], org, dir);
+  rval = BVH->fireRay(ray, skip_entry);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  CHECK_REAL_EQUAL(15.0, ray.tfar, 1e-12);
+  ray = make_ray(vols[0], org, dir);
+  rval = BVH->fireRay(ray, skip_other);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  CHECK_REAL_EQUAL(5.0, ray.tfar, 1e-12);
+
+  // without a filter the hit is resolved after traversal
+  ray = make_ray(vols[0], org, dir);
+  rval = BVH->fireRay(ray, no_filter);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  CHECK_REAL_EQUAL(5.0, ray.tfar, 1e-12);
+  CHECK_EQUAL(plain.geomID, ray.geomID);
+
+  // occlusion of a segment ending inside the cube
+  MBRay seg(org, dir, 0.0, 10.0);
+  seg.instID = vols[0];
+  bool occluded;
+  ray = seg;
+  rval = BVH->fireOcclusionRay(ray, occluded, no_filter);
+  MB_CHK_SET_ERR(rval, "Failed to fire occlusion ray");
+  CHECK(occluded);
+  ray = seg;
+  rval = BVH->fireOcclusionRay(ray, occluded, cull);
+  MB_CHK_SET_ERR(rval, "Failed to fire occlusion ray");
+  CHECK(!occluded);
+
+  // all hits
+  MBRayHit hits[4];
+  size_t num_hits;
+  rval = BVH->fireRayAllHits(make_ray(vols[0], org, dir), hits, 4, num_hits, no_filter);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  CHECK_EQUAL((size_t)2, num_hits);
+  rval = BVH->fireRayAllHits(make_ray(vols[0], org, dir), hits, 4, num_hits, skip_entry);
+  MB_CHK_SET_ERR(rval, "Failed to fire ray");
+  CHECK_EQUAL((size_t)1, num_hits);
+  CHECK_REAL_EQUAL(15.0, hits[0].dist, 1e-12);
+
+  delete BVH;
+  delete MBI;
+
+  return 0;
+}
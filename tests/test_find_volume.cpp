@@ -0,0 +1,163 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_POINTS 1000
+
+// findVolume agrees with testing every volume in turn
+void check_find_volume(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  moab::EntityHandle found;
+  rval = MBVHM.findVolume(Vec3da(0.0, 0.0, 0.0), found);
+  CHECK_EQUAL(moab::MB_FAILURE, rval);
+
+  rval = MBVHM.build_scene_tree();
+  MB_CHK_SET_ERR_RET(rval, "Failed to build the scene tree");
+
+  std::vector<Vec3da> points(NUM_POINTS);
+  for (size_t i = 0; i < points.size(); i++) points[i] = random_vec(extent);
+
+  std::vector<moab::EntityHandle> expected(points.size(), 0);
+  size_t num_found = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    for (moab::Range::iterator vi = vols.begin(); vi != vols.end(); vi++) {
+      int inside;
+      rval = MBVHM.pointInVolume(*vi, points[i], inside);
+      MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+      if (inside) { expected[i] = *vi; break; }
+    }
+
+    rval = MBVHM.findVolume(points[i], found);
+    MB_CHK_SET_ERR_RET(rval, "Failed to find the volume of the point");
+    CHECK_EQUAL(expected[i], found);
+    if (found) num_found++;
+  }
+  CHECK(num_found > 0);
+  CHECK(num_found < points.size());
+
+  std::vector<moab::EntityHandle> batch;
+  rval = MBVHM.findVolumes(&points[0], points.size(), batch);
+  MB_CHK_SET_ERR_RET(rval, "Failed to find the volumes of the points");
+  CHECK_EQUAL(points.size(), batch.size());
+  for (size_t i = 0; i < points.size(); i++) CHECK_EQUAL(expected[i], batch[i]);
+
+  // and with the volume grids
+  rval = MBVHM.build_grids(16);
+  MB_CHK_SET_ERR_RET(rval, "Failed to build the grids");
+  rval = MBVHM.findVolumes(&points[0], points.size(), batch);
+  MB_CHK_SET_ERR_RET(rval, "Failed to find the volumes of the points");
+  for (size_t i = 0; i < points.size(); i++) CHECK_EQUAL(expected[i], batch[i]);
+}
+
+// a regular tetrahedron with one surface
+moab::EntityHandle make_tetrahedron(moab::Interface* mbi) {
+  moab::Tag dim_tag, sense_tag;
+  mbi->tag_get_handle(GEOM_DIMENSION_TAG_NAME, 1, moab::MB_TYPE_INTEGER, dim_tag, moab::MB_TAG_SPARSE|moab::MB_TAG_CREAT);
+  mbi->tag_get_handle("GEOM_SENSE_2", 2, moab::MB_TYPE_HANDLE, sense_tag, moab::MB_TAG_SPARSE|moab::MB_TAG_CREAT);
+
+  Vec3da corners[4] = { Vec3da(1.0, 1.0, 1.0),
+			Vec3da(1.0, -1.0, -1.0),
+			Vec3da(-1.0, 1.0, -1.0),
+			Vec3da(-1.0, -1.0, 1.0) };
+
+  moab::EntityHandle verts[4];
+  for (size_t i = 0; i < 4; i++) {
+    double c[3] = {corners[i][0], corners[i][1], corners[i][2]};
+    mbi->create_vertex(c, verts[i]);
+  }
+
+  moab::EntityHandle surf, vol;
+  mbi->create_meshset(0, surf);
+  mbi->create_meshset(0, vol);
+  int dim = 2;
+  mbi->tag_set_data(dim_tag, &surf, 1, &dim);
+  dim = 3;
+  mbi->tag_set_data(dim_tag, &vol, 1, &dim);
+  moab::EntityHandle senses[2] = {vol, 0};
+  mbi->tag_set_data(sense_tag, &surf, 1, senses);
+  mbi->add_parent_child(vol, surf);
+
+  // the face opposite each corner, oriented away from it
+  for (size_t i = 0; i < 4; i++) {
+    size_t a = (i+1)%4, b = (i+2)%4, c = (i+3)%4;
+    if (dot(cross(corners[b]-corners[a], corners[c]-corners[a]), corners[a]-corners[i]) < 0.0) std::swap(b, c);
+    moab::EntityHandle conn[3] = {verts[a], verts[b], verts[c]}, tri;
+    mbi->create_element(moab::MBTRI, conn, 3, tri);
+    mbi->add_entities(surf, &tri, 1);
+  }
+
+  return vol;
+}
+
+// the flat tree of a volume with few triangles is a single leaf
+void test_flat_leaf_volume() {
+
+  moab::Interface* mbi = new moab::Core();
+
+  moab::ErrorCode rval;
+
+  moab::EntityHandle vol = make_tetrahedron(mbi);
+
+  MBVHManager MBVHM(mbi);
+  MBVHM.flatVolumes = true;
+
+  rval = MBVHM.build_all();
+  MB_CHK_SET_ERR_RET(rval, "Failed to build trees for the model");
+  CHECK(MBVHM.get_root(vol)->isLeaf());
+
+  // built twice, the first tree is freed
+  for (int i = 0; i < 2; i++) {
+    rval = MBVHM.build_scene_tree();
+    MB_CHK_SET_ERR_RET(rval, "Failed to build the scene tree");
+  }
+
+  moab::EntityHandle found;
+  rval = MBVHM.findVolume(Vec3da(0.0, 0.0, 0.0), found);
+  MB_CHK_SET_ERR_RET(rval, "Failed to find the volume of the point");
+  CHECK_EQUAL(vol, found);
+
+  rval = MBVHM.findVolume(Vec3da(2.0, 0.0, 0.0), found);
+  MB_CHK_SET_ERR_RET(rval, "Failed to find the volume of the point");
+  CHECK_EQUAL((moab::EntityHandle)0, found);
+
+  size_t num_found = 0;
+  for (size_t i = 0; i < NUM_POINTS; i++) {
+    Vec3da p = random_vec(1.5);
+    int inside;
+    rval = MBVHM.pointInVolume(vol, p, inside);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+    rval = MBVHM.findVolume(p, found);
+    MB_CHK_SET_ERR_RET(rval, "Failed to find the volume of the point");
+    CHECK_EQUAL(inside ? vol : 0, found);
+    num_found += inside;
+  }
+  CHECK(num_found > 0);
+
+  // cleanup
+  delete mbi;
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  check_find_volume(TEST_CUBE, 10.0);
+  check_find_volume(TEST_CUBE_CYLINDER, 12.0);
+  check_find_volume(TEST_SMALL_SPHERE, 20.0);
+  test_flat_leaf_volume();
+
+  return 0;
+}
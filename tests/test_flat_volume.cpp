@@ -0,0 +1,182 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_RAYS 5000
+
+// surface of each triangle and the forward volume of that surface
+struct TriInfo {
+  std::map<moab::EntityHandle, moab::EntityHandle> surface;
+  std::map<moab::EntityHandle, moab::EntityHandle> fwd;
+};
+
+moab::ErrorCode get_tri_info(moab::Interface* mbi, TriInfo& info) {
+  moab::ErrorCode rval;
+
+  moab::Range surfs;
+  rval = get_geom_sets_with_dim(mbi, 2, surfs);
+  MB_CHK_SET_ERR(rval, "Failed to retrieve surfaces");
+
+  moab::Tag sense_tag;
+  rval = mbi->tag_get_handle("GEOM_SENSE_2", sense_tag);
+  MB_CHK_SET_ERR(rval, "Failed to get the sense tag");
+
+  for(moab::Range::iterator si = surfs.begin(); si != surfs.end(); si++) {
+    moab::EntityHandle senses[2];
+    rval = mbi->tag_get_data(sense_tag, &(*si), 1, senses);
+    MB_CHK_SET_ERR(rval, "Failed to get the surface senses");
+
+    std::vector<moab::EntityHandle> tris;
+    rval = mbi->get_entities_by_type(*si, moab::MBTRI, tris);
+    MB_CHK_SET_ERR(rval, "Failed to get surface triangles");
+    for(size_t i = 0; i < tris.size(); i++) {
+      info.surface[tris[i]] = *si;
+      info.fwd[tris[i]] = senses[0];
+    }
+  }
+
+  return moab::MB_SUCCESS;
+}
+
+Vec3da tri_normal(moab::Interface* mbi, moab::EntityHandle tri) {
+  std::vector<moab::EntityHandle> conn;
+  mbi->get_connectivity(&tri, 1, conn);
+  double c[9];
+  mbi->get_coords(&conn[0], 3, c);
+  Vec3da v0(c[0], c[1], c[2]), v1(c[3], c[4], c[5]), v2(c[6], c[7], c[8]);
+  Vec3da n = cross(v1-v0, v2-v0);
+  n.normalize();
+  return n;
+}
+
+// The hit of a flat tree is on the surface of its triangle, with the
+// normal of the triangle turned by the sense of that surface with
+// respect to the volume
+void check_hit(moab::Interface* mbi, TriInfo& info, const MBRay& ray) {
+  CHECK(info.surface.count(ray.primID));
+  CHECK_EQUAL(info.surface[ray.primID], (moab::EntityHandle)ray.geomID);
+
+  Vec3da n = tri_normal(mbi, ray.primID);
+  if(info.fwd[ray.primID] != (moab::EntityHandle)ray.instID) n = -n;
+  CHECK_REAL_EQUAL(1.0, dot(n, ray.Ng), 1e-6);
+}
+
+// queries on flat volume trees against the same queries on joined surface trees
+void check_flat_volume(const char* filename, double extent) {
+
+  moab::Interface* mbi = new moab::Core();
+  moab::Interface* flat_mbi = new moab::Core();
+
+  moab::ErrorCode rval;
+
+  rval = mbi->load_file(filename);
+  MB_CHK_SET_ERR_RET(rval, "Failed to load the test file");
+
+  rval = flat_mbi->load_file(filename);
+  MB_CHK_SET_ERR_RET(rval, "Failed to load the test file");
+
+  MBVHManager MBVHM(mbi);
+  rval = MBVHM.build_all();
+  MB_CHK_SET_ERR_RET(rval, "Failed to build trees for the model");
+
+  MBVHManager flat(flat_mbi);
+  flat.flatVolumes = true;
+  rval = flat.build_all();
+  MB_CHK_SET_ERR_RET(rval, "Failed to build flat trees for the model");
+
+  moab::Range vols, surfs;
+  rval = get_geom_sets_with_dim(mbi, 3, vols);
+  MB_CHK_SET_ERR_RET(rval, "Failed to retrieve volumes from MOAB instance");
+  rval = get_geom_sets_with_dim(mbi, 2, surfs);
+  MB_CHK_SET_ERR_RET(rval, "Failed to retrieve surfaces from MOAB instance");
+
+  // only the volume trees are built
+  for(moab::Range::iterator vi = vols.begin(); vi != vols.end(); vi++) CHECK(flat.get_root(*vi));
+  for(moab::Range::iterator si = surfs.begin(); si != surfs.end(); si++) CHECK(!flat.get_root(*si));
+
+  TriInfo info;
+  rval = get_tri_info(flat_mbi, info);
+  MB_CHK_SET_ERR_RET(rval, "Failed to get the triangle surfaces");
+
+  std::vector<MBRayHit> hits, flat_hits;
+  std::vector<MBTrackCrossing> crossings, flat_crossings;
+  size_t num_hits = 0;
+  for(size_t j = 0; j < NUM_RAYS; j++) {
+    MBRay ray(random_vec(extent), random_dir());
+    ray.instID = vols[j % vols.size()];
+
+    // closest hit, the triangle may differ where the ray crosses an edge
+    MBRay ref = ray, flat_ray = ray;
+    rval = MBVHM.fireRay(ref);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+    rval = flat.fireRay(flat_ray);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray on the flat tree");
+    CHECK_EQUAL(ref.geomID == -1, flat_ray.geomID == -1);
+    if(ref.geomID == -1) continue;
+    num_hits++;
+    CHECK_REAL_EQUAL(ref.tfar, flat_ray.tfar, 0.0);
+    check_hit(flat_mbi, info, flat_ray);
+
+    // all hits carry the surface and sense of their triangles
+    rval = MBVHM.fireRayAllHits(ray, hits);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray for all hits");
+    rval = flat.fireRayAllHits(ray, flat_hits);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray for all hits on the flat tree");
+    CHECK_EQUAL(hits.size(), flat_hits.size());
+    for(size_t i = 0; i < flat_hits.size(); i++) {
+      CHECK_REAL_EQUAL(hits[i].dist, flat_hits[i].dist, 0.0);
+      CHECK_EQUAL(info.surface[flat_hits[i].primID], flat_hits[i].setID);
+      CHECK_EQUAL(info.fwd[flat_hits[i].primID] == ray.instID ? 0 : 1, flat_hits[i].sense);
+    }
+
+    // closest point
+    MBRay loc = ray, flat_loc = ray;
+    rval = MBVHM.closestToLocation(loc);
+    MB_CHK_SET_ERR_RET(rval, "Failed to find the closest point");
+    rval = flat.closestToLocation(flat_loc);
+    MB_CHK_SET_ERR_RET(rval, "Failed to find the closest point on the flat tree");
+    CHECK_REAL_EQUAL(loc.tfar, flat_loc.tfar, 0.0);
+    CHECK(info.surface.count(flat_loc.primID));
+    CHECK_EQUAL(info.surface[flat_loc.primID], (moab::EntityHandle)flat_loc.geomID);
+
+    // containment and the walk use the senses of the surfaces hit
+    int result, flat_result;
+    rval = MBVHM.pointInVolume(ray.instID, ray.org, result);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify the point");
+    rval = flat.pointInVolume(ray.instID, ray.org, flat_result);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify the point on the flat tree");
+    CHECK_EQUAL(result, flat_result);
+
+    rval = MBVHM.walkTrack(ray, crossings);
+    MB_CHK_SET_ERR_RET(rval, "Failed to walk the track");
+    rval = flat.walkTrack(ray, flat_crossings);
+    MB_CHK_SET_ERR_RET(rval, "Failed to walk the track on the flat trees");
+    CHECK_EQUAL(crossings.size(), flat_crossings.size());
+    for(size_t i = 0; i < flat_crossings.size(); i++) {
+      CHECK_EQUAL(crossings[i].volume, flat_crossings[i].volume);
+      CHECK_EQUAL(crossings[i].next, flat_crossings[i].next);
+      CHECK_REAL_EQUAL(crossings[i].dist, flat_crossings[i].dist, 0.0);
+    }
+  }
+  CHECK(num_hits > 0);
+
+  // cleanup
+  delete mbi;
+  delete flat_mbi;
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  check_flat_volume(TEST_CUBE, 10.0);
+  check_flat_volume(TEST_CUBE_CYLINDER, 10.0);
+  check_flat_volume(TEST_SMALL_SPHERE, 20.0);
+
+  return 0;
+}
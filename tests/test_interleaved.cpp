@@ -0,0 +1,63 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_RAYS 10000
+
+// compare the interleaved traversal of a batch to firing one ray at a time
+void compare_interleaved(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<MBRay> single;
+
+  for(size_t j = 0; j < NUM_RAYS; j++) {
+    MBRay ray = random_ray(vols, j, extent);
+    single.push_back(ray);
+  }
+
+  std::vector<MBRay> rays = single;
+
+  for(size_t j = 0; j < single.size(); j++) {
+    rval = MBVHM.fireRay(single[j]);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  }
+
+  // fewer, as many and more rays in flight than rays in the batch
+  size_t in_flight[4] = {2, 8, 64, NUM_RAYS+1};
+  ChildOrder orders[2] = {CHILD_ORDER_DISTANCE, CHILD_ORDER_DISTANCE_SIMD};
+
+  for(size_t o = 0; o < 2; o++) {
+    MBVHM.MOABBVH->set_child_order(orders[o]);
+    for(size_t f = 0; f < 4; f++) {
+      std::vector<MBRay> batch = rays;
+      MBVHM.MOABBVH->set_rays_in_flight(in_flight[f]);
+      CHECK_EQUAL(in_flight[f], MBVHM.MOABBVH->rays_in_flight());
+      rval = MBVHM.fireRays(&(batch[0]), batch.size());
+      MB_CHK_SET_ERR_RET(rval, "Failed to fire ray batch");
+      for(size_t j = 0; j < single.size(); j++) check_same_hit(single[j], batch[j]);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  compare_interleaved(TEST_CUBE, 10.0);
+  compare_interleaved(TEST_CUBE_CYLINDER, 10.0);
+  compare_interleaved(TEST_SMALL_SPHERE, 2.0);
+
+  return 0;
+}
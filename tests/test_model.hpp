@@ -0,0 +1,105 @@
+#ifndef TEST_MODEL_HPP
+#define TEST_MODEL_HPP
+
+// fixtures shared by the tests that fire queries at the test models
+
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+
+#include <cstdlib>
+
+// gets all EntitySets in the MOAB instance with a Geometry Dimension Tag and a value of dim
+inline moab::ErrorCode get_geom_sets_with_dim(moab::Interface* mbi, int dim, moab::Range& entsets){
+  moab::ErrorCode rval;
+
+  moab::Tag geom_dim_tag;
+  rval = mbi->tag_get_handle(GEOM_DIMENSION_TAG_NAME, geom_dim_tag);
+  MB_CHK_SET_ERR(rval, "Failed to get the geom dim tag handle");
+
+  void *ptr = &dim;
+  rval = mbi->get_entities_by_type_and_tag(0, moab::MBENTITYSET, &geom_dim_tag, &ptr, 1, entsets);
+  MB_CHK_SET_ERR(rval, "Failed to retrieve geometry sets");
+
+  return rval;
+}
+
+// a model loaded into its own MOAB instance with trees built for all of
+// its volumes, rval holds the result of the setup
+struct TestModel {
+
+  TestModel(const char* filename) : mbi(new moab::Core()), MBVHM(NULL) { rval = load(filename); }
+
+  ~TestModel() { delete MBVHM; delete mbi; }
+
+  moab::Interface* mbi;
+  MBVHManager* MBVHM;
+  moab::Range vols;
+  moab::ErrorCode rval;
+
+ private:
+
+  moab::ErrorCode load(const char* filename) {
+    moab::ErrorCode rval;
+
+    rval = mbi->load_file(filename);
+    MB_CHK_SET_ERR(rval, "Failed to load the test file");
+
+    MBVHM = new MBVHManager(mbi);
+
+    rval = MBVHM->build_all();
+    MB_CHK_SET_ERR(rval, "Failed to build trees for the model");
+
+    rval = get_geom_sets_with_dim(mbi, 3, vols);
+    MB_CHK_SET_ERR(rval, "Failed to retrieve volumes from MOAB instance");
+
+    return rval;
+  }
+
+  TestModel(const TestModel&);
+  TestModel& operator=(const TestModel&);
+};
+
+inline Vec3da random_vec(double scale) {
+  return Vec3da(scale*(2.0*rand()/RAND_MAX - 1.0),
+		scale*(2.0*rand()/RAND_MAX - 1.0),
+		scale*(2.0*rand()/RAND_MAX - 1.0));
+}
+
+inline Vec3da random_dir() {
+  Vec3da dir;
+  do {
+    dir = random_vec(1.0);
+  } while (dir.length() == 0.0);
+  dir.normalize();
+  return dir;
+}
+
+// the j-th ray of a random set, with origins both inside and outside of
+// the volumes, cycling through the volumes and the three orientations
+inline MBRay random_ray(const moab::Range& vols, size_t j, double extent) {
+  Vec3da org = random_vec(extent), dir = random_dir();
+  int orientation = (j % 3) - 1;
+
+  MBRay ray(org, dir, 0.0, inf, -1, orientation);
+  ray.instID = vols[j % vols.size()];
+  return ray;
+}
+
+// two queries of the same ray found the same hit
+inline void check_same_hit(const MBRay& a, const MBRay& b) {
+  if ( a.tfar == (double)inf ) {
+    CHECK(b.tfar == (double)inf);
+    return;
+  }
+
+  CHECK_REAL_EQUAL(a.tfar, b.tfar, 0.0);
+  CHECK_EQUAL(a.primID, b.primID);
+  CHECK_EQUAL(a.geomID, b.geomID);
+  CHECK_REAL_EQUAL(a.Ng[0], b.Ng[0], 0.0);
+  CHECK_REAL_EQUAL(a.Ng[1], b.Ng[1], 0.0);
+  CHECK_REAL_EQUAL(a.Ng[2], b.Ng[2], 0.0);
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_RAYS 10000
+
+// rejects every hit
+void reject_all(MBRay &ray, void*) {
+  ray.geomID = -1;
+  ray.primID = -1;
+}
+
+// compare occlusion queries to the closest hit of the same ray segment
+void compare_occlusion(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<MBRay> rays;
+
+  for(size_t j = 0; j < NUM_RAYS; j++) {
+    // origins both inside and outside of the volumes, in all volumes
+    Vec3da org = random_vec(extent), dir = random_dir();
+    int orientation = (j % 3) - 1;
+    // segments of random length, some of them unbounded
+    double tnear = (j % 5 == 0) ? 0.1*extent*rand()/RAND_MAX : 0.0;
+    double tfar = (j % 4 == 0) ? (double)inf : tnear + 2.0*extent*rand()/RAND_MAX;
+
+    MBRay ray(org, dir, tnear, tfar, -1, orientation);
+    ray.instID = vols[j % vols.size()];
+    rays.push_back(ray);
+  }
+
+  size_t num_occluded = 0;
+  for(size_t j = 0; j < rays.size(); j++) {
+    MBRay closest = rays[j];
+    rval = MBVHM.fireRay(closest);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+
+    MBRay any = rays[j];
+    bool occluded;
+    rval = MBVHM.fireOcclusionRay(any, occluded);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire occlusion ray");
+
+    CHECK_EQUAL(closest.primID != (moab::EntityHandle)-1, occluded);
+    if ( !occluded ) {
+      CHECK_EQUAL((moab::EntityHandle)-1, any.primID);
+      continue;
+    }
+
+    // any hit on the segment, no closer than the closest one
+    num_occluded++;
+    CHECK(any.primID != (moab::EntityHandle)-1);
+    CHECK(any.tfar >= closest.tfar);
+    CHECK(any.tfar >= rays[j].tnear);
+    CHECK(any.tfar < rays[j].tfar);
+  }
+  CHECK(num_occluded > 0);
+
+  // batched form
+  std::vector<MBRay> batch = rays;
+  std::vector<bool> occluded;
+  rval = MBVHM.fireOcclusionRays(&(batch[0]), batch.size(), occluded);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire occlusion rays");
+  CHECK_EQUAL(rays.size(), occluded.size());
+  for(size_t j = 0; j < rays.size(); j++) {
+    MBRay any = rays[j];
+    bool single;
+    rval = MBVHM.fireOcclusionRay(any, single);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire occlusion ray");
+    CHECK_EQUAL(single, (bool)occluded[j]);
+  }
+
+  // hits rejected by a filter do not occlude
+  MBVHM.MOABBVH->set_filter(reject_all);
+  for(size_t j = 0; j < 100; j++) {
+    MBRay any = rays[j];
+    bool occ;
+    rval = MBVHM.fireOcclusionRay(any, occ);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire occlusion ray");
+    CHECK(!occ);
+  }
+  MBVHM.MOABBVH->unset_filter();
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  compare_occlusion(TEST_CUBE, 10.0);
+  compare_occlusion(TEST_CUBE_CYLINDER, 10.0);
+  compare_occlusion(TEST_SMALL_SPHERE, 2.0);
+
+  return 0;
+}
@@ -0,0 +1,61 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_RAYS 10000
+
+// compare the octant specialized and batched traversals to the generic one
+void compare_kernels(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<MBRay> generic, batch;
+
+  for(size_t j = 0; j < NUM_RAYS; j++) {
+    MBRay ray = random_ray(vols, j, extent);
+    // include rays along the axes, which fall in the positive octants
+    if ( j % 10 == 0 ) { ray.dir = Vec3da(0.0, 0.0, 0.0); ray.dir[j % 3] = (j % 20) ? 1.0 : -1.0; }
+    generic.push_back(ray);
+    batch.push_back(ray);
+  }
+
+  MBVHM.MOABBVH->set_octant_kernels(false);
+  for(size_t j = 0; j < generic.size(); j++) {
+    rval = MBVHM.fireRay(generic[j]);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  }
+
+  MBVHM.MOABBVH->set_octant_kernels(true);
+  for(size_t j = 0; j < generic.size(); j++) {
+    MBRay ray = batch[j];
+    rval = MBVHM.fireRay(ray);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+    check_same_hit(generic[j], ray);
+  }
+
+  rval = MBVHM.fireRays(&(batch[0]), batch.size());
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray batch");
+  for(size_t j = 0; j < generic.size(); j++) check_same_hit(generic[j], batch[j]);
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  compare_kernels(TEST_CUBE, 10.0);
+  compare_kernels(TEST_CUBE_CYLINDER, 10.0);
+  compare_kernels(TEST_SMALL_SPHERE, 2.0);
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+
+#include "testutil.hpp"
+#include "test_files.h"
+
+#include "MBVHManager.h"
+#include "moab/Core.hpp"
+
+// same screening as ORIENT_FORWARD, applied after the hit is accepted
+void backface_cull(MBRay &ray, void*) {
+  if(dot(ray.dir, ray.Ng) < 0.0) {
+    ray.geomID = -1;
+    ray.primID = -1;
+  }
+  return;
+}
+
+void fire(MBVHManager* BVH, moab::EntityHandle vol, const Vec3da& org, const Vec3da& dir, int orientation, MBRay& ray) {
+  ray = MBRay(org, dir, 0.0, inf, -1, orientation);
+  ray.instID = vol;
+  moab::ErrorCode rval = BVH->fireRay(ray);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+}
+
+int main(int argc, char** argv) {
+
+  moab::ErrorCode rval = moab::MB_SUCCESS;
+
+  moab::Interface* MBI = new moab::Core();
+
+  rval = MBI->load_file(TEST_CUBE);
+  MB_CHK_SET_ERR(rval, "Failed to load the test file");
+
+  MBVHManager* BVH = new MBVHManager(MBI);
+  rval = BVH->build_all();
+  MB_CHK_SET_ERR(rval, "Failed to build tree(2) for the model");
+
+  moab::Tag geom_dim_tag;
+  rval = MBI->tag_get_handle(GEOM_DIMENSION_TAG_NAME, geom_dim_tag);
+  MB_CHK_SET_ERR(rval, "Failed to get the geom dim tag handle");
+
+  moab::Range vols;
+  int dim = 3;
+  void *ptr = &dim;
+  rval = MBI->get_entities_by_type_and_tag(0, moab::MBENTITYSET, &geom_dim_tag, &ptr, 1, vols);
+  MB_CHK_SET_ERR(rval, "Failed to retrieve volume entitysets");
+
+  CHECK_EQUAL(1, (int)vols.size());
+
+  MBRay ray;
+
+  // default constructed rays report hits of any orientation
+  CHECK_EQUAL((int)ORIENT_ANY, ray.orientation);
+
+  // ray from outside the cube: enters at x = -5, exits at x = 5
+  Vec3da org(-10.0, 0.0, 0.0), dir(1.0, 0.0, 0.0);
+
+  fire(BVH, vols[0], org, dir, ORIENT_ANY, ray);
+  CHECK_REAL_EQUAL(5.0, ray.tfar, 0.0);
+  CHECK(dot(ray.dir, ray.Ng) < 0.0);
+
+  fire(BVH, vols[0], org, dir, ORIENT_FORWARD, ray);
+  CHECK_REAL_EQUAL(15.0, ray.tfar, 0.0);
+  CHECK(dot(ray.dir, ray.Ng) > 0.0);
+
+  fire(BVH, vols[0], org, dir, ORIENT_REVERSE, ray);
+  CHECK_REAL_EQUAL(5.0, ray.tfar, 0.0);
+  CHECK(dot(ray.dir, ray.Ng) < 0.0);
+
+  // ray from inside the cube only exits
+  org = Vec3da(0.0, 0.0, 0.0);
+  fire(BVH, vols[0], org, dir, ORIENT_FORWARD, ray);
+  CHECK_REAL_EQUAL(5.0, ray.tfar, 0.0);
+
+  fire(BVH, vols[0], org, dir, ORIENT_REVERSE, ray);
+  CHECK(ray.tfar == (double)inf);
+  CHECK_EQUAL((moab::EntityHandle)-1, ray.primID);
+
+  // native screening must agree with the equivalent filter function
+  org = Vec3da(-10.0, 0.1, -0.2);
+  dir = Vec3da(1.0, 0.05, 0.02);
+  dir.normalize();
+
+  MBRay filtered;
+  BVH->MOABBVH->set_filter(backface_cull);
+  fire(BVH, vols[0], org, dir, ORIENT_ANY, filtered);
+  BVH->MOABBVH->unset_filter();
+
+  fire(BVH, vols[0], org, dir, ORIENT_FORWARD, ray);
+  CHECK_REAL_EQUAL(filtered.tfar, ray.tfar, 0.0);
+  CHECK_EQUAL(filtered.primID, ray.primID);
+  CHECK_EQUAL(filtered.geomID, ray.geomID);
+
+  return rval;
+
+}
@@ -0,0 +1,83 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+// not a multiple of the packet size, so that the last packet is partial
+#define NUM_RAYS 5001
+
+// compare packet traversal to single ray traversal for bundles of rays
+// leaving a common source point, spread around a direction by up to spread
+void compare_packets(const char* filename, double extent, double spread) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<MBRay> single;
+  Vec3da org, axis;
+
+  for(size_t j = 0; j < NUM_RAYS; j++) {
+    // a new source point and volume every 16 rays
+    if ( j % 16 == 0 ) { org = random_vec(extent); axis = random_dir(); }
+    Vec3da dir = axis + random_vec(spread);
+    dir.normalize();
+    int orientation = (j % 3) - 1;
+
+    MBRay ray(org, dir, 0.0, inf, -1, orientation);
+    ray.instID = vols[(j / 16) % vols.size()];
+    single.push_back(ray);
+  }
+
+  std::vector<MBRay> rays = single;
+
+  for(size_t j = 0; j < single.size(); j++) {
+    rval = MBVHM.fireRay(single[j]);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  }
+
+  // packets that never fall back, fall back as in the default and
+  // always fall back to single rays
+  size_t min_active[3] = {0, 2, 9};
+  size_t packet_sizes[2] = {4, 8};
+
+  for(size_t m = 0; m < 3; m++) {
+    for(size_t p = 0; p < 2; p++) {
+      std::vector<MBRay> packets = rays;
+      MBVHM.MOABBVH->set_packet_min_active(min_active[m]);
+      rval = MBVHM.fireRayPackets(&(packets[0]), packets.size(), packet_sizes[p]);
+      MB_CHK_SET_ERR_RET(rval, "Failed to fire ray packets");
+      for(size_t j = 0; j < single.size(); j++) check_same_hit(single[j], packets[j]);
+    }
+  }
+
+  // restore the default
+  MBVHM.MOABBVH->set_packet_min_active(2);
+
+  // unsupported packet size
+  rval = MBVHM.fireRayPackets(&(rays[0]), rays.size(), 5);
+  CHECK(rval != moab::MB_SUCCESS);
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  // nearly parallel and incoherent bundles
+  compare_packets(TEST_CUBE, 10.0, 0.01);
+  compare_packets(TEST_CUBE, 10.0, 1.0);
+  compare_packets(TEST_CUBE_CYLINDER, 10.0, 0.01);
+  compare_packets(TEST_CUBE_CYLINDER, 10.0, 1.0);
+  compare_packets(TEST_SMALL_SPHERE, 2.0, 0.01);
+  compare_packets(TEST_SMALL_SPHERE, 2.0, 1.0);
+
+  return 0;
+}
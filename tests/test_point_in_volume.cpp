@@ -0,0 +1,170 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_POINTS 2000
+
+// the cube model spans [-5, 5] in each direction
+void test_cube() {
+
+  TestModel model(TEST_CUBE);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+  CHECK_EQUAL(1, (int)vols.size());
+  moab::EntityHandle vol = vols[0];
+
+  std::vector<Vec3da> points;
+  std::vector<int> expected;
+  while (points.size() < NUM_POINTS) {
+    Vec3da p = random_vec(10.0);
+    double d = std::max(fabs(p[0]), std::max(fabs(p[1]), fabs(p[2])));
+    if (fabs(d - 5.0) < 1e-3) continue;
+    points.push_back(p);
+    expected.push_back(d < 5.0 ? 1 : 0);
+  }
+
+  // points whose first ray runs into a vertex or along an edge of the cube
+  Vec3da dir(0.5213, 0.2347, 0.8205);
+  dir.normalize();
+  points.push_back(Vec3da(5.0, 5.0, 5.0) - 3.0 * dir);
+  expected.push_back(1);
+  points.push_back(Vec3da(5.0, 5.0, 5.0) + 3.0 * dir);
+  expected.push_back(0);
+  points.push_back(Vec3da(5.0, 0.0, 0.0) - 2.0 * dir);
+  expected.push_back(1);
+
+  // nearest the edges and corners of the cube
+  points.push_back(Vec3da(6.0, 6.0, 0.0));
+  expected.push_back(0);
+  points.push_back(Vec3da(4.9, -4.9, 4.9));
+  expected.push_back(1);
+  points.push_back(Vec3da(0.0, 0.0, 0.0));
+  expected.push_back(1);
+
+  for (int mode = PIV_RAY; mode <= PIV_CLOSEST; mode++) {
+    for (size_t i = 0; i < points.size(); i++) {
+      int result = -1;
+      rval = MBVHM.pointInVolume(vol, points[i], result, mode);
+      MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+      CHECK_EQUAL(expected[i], result);
+    }
+
+    std::vector<int> results;
+    rval = MBVHM.pointsInVolume(vol, &points[0], points.size(), results, mode);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify points");
+    CHECK_EQUAL(expected.size(), results.size());
+    for (size_t i = 0; i < points.size(); i++) CHECK_EQUAL(expected[i], results[i]);
+  }
+
+  // every ray from a corner starts on a vertex, so the rays fall back to
+  // the nearest boundary feature
+  for (int i = 0; i < 8; i++) {
+    Vec3da corner(i & 1 ? 5.0 : -5.0, i & 2 ? 5.0 : -5.0, i & 4 ? 5.0 : -5.0);
+    int by_ray = -1, by_closest = -1;
+    rval = MBVHM.pointInVolume(vol, corner, by_ray, PIV_RAY);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+    rval = MBVHM.pointInVolume(vol, corner, by_closest, PIV_CLOSEST);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+    CHECK_EQUAL(by_closest, by_ray);
+  }
+
+  int result;
+  rval = MBVHM.pointInVolume(vol, points[0], result, 2);
+  CHECK_EQUAL(moab::MB_FAILURE, rval);
+}
+
+// both modes and the batched form agree for points in every volume
+void compare_modes(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<Vec3da> points(NUM_POINTS);
+  for (size_t i = 0; i < points.size(); i++) points[i] = random_vec(extent);
+
+  for (moab::Range::iterator vi = vols.begin(); vi != vols.end(); vi++) {
+    std::vector<int> batch;
+    rval = MBVHM.pointsInVolume(*vi, &points[0], points.size(), batch);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify points");
+
+    size_t num_inside = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+      int by_ray, by_closest;
+      rval = MBVHM.pointInVolume(*vi, points[i], by_ray, PIV_RAY);
+      MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+      rval = MBVHM.pointInVolume(*vi, points[i], by_closest, PIV_CLOSEST);
+      MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+      CHECK_EQUAL(by_ray, batch[i]);
+      CHECK_EQUAL(by_ray, by_closest);
+      num_inside += by_ray;
+    }
+    CHECK(num_inside > 0);
+  }
+}
+
+// rejects every hit
+void reject_all(MBRay &ray, void*) {
+  ray.geomID = -1;
+}
+
+// the classification does not depend on the query settings of the tree
+void test_tree_settings(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<Vec3da> points(NUM_POINTS/10);
+  for (size_t i = 0; i < points.size(); i++) points[i] = random_vec(extent);
+
+  for (moab::Range::iterator vi = vols.begin(); vi != vols.end(); vi++) {
+    std::vector<int> expected;
+    rval = MBVHM.pointsInVolume(*vi, &points[0], points.size(), expected, PIV_RAY);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify points");
+
+    MBVHM.MOABBVH->set_filter(reject_all);
+    MBVHM.MOABBVH->set_short_stack(true);
+    MBVHM.MOABBVH->set_child_order(CHILD_ORDER_DISTANCE_SIMD);
+
+    for (size_t i = 0; i < points.size(); i++) {
+      int result = -1;
+      rval = MBVHM.pointInVolume(*vi, points[i], result, PIV_RAY);
+      MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+      CHECK_EQUAL(expected[i], result);
+    }
+
+    MBVHM.MOABBVH->unset_filter();
+    MBVHM.MOABBVH->set_short_stack(false);
+    MBVHM.MOABBVH->set_child_order(CHILD_ORDER_DISTANCE);
+  }
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  test_cube();
+  compare_modes(TEST_CUBE_CYLINDER, 10.0);
+  compare_modes(TEST_SMALL_SPHERE, 20.0);
+  test_tree_settings(TEST_CUBE_CYLINDER, 10.0);
+
+  return 0;
+}
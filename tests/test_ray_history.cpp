@@ -0,0 +1,151 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+void test_history_ops() {
+  MBRayHistory history;
+  CHECK(history.empty());
+
+  history.add(1);
+  history.add(2);
+  history.add(3);
+  CHECK_EQUAL((size_t)3, history.size());
+  CHECK_EQUAL((moab::EntityHandle)3, history.last());
+  CHECK(history.contains(1));
+  CHECK(!history.contains(4));
+
+  history.rollback();
+  CHECK_EQUAL((size_t)2, history.size());
+  CHECK_EQUAL((moab::EntityHandle)2, history.last());
+  CHECK(!history.contains(3));
+
+  history.add(5);
+  history.reset_to_last();
+  CHECK_EQUAL((size_t)1, history.size());
+  CHECK_EQUAL((moab::EntityHandle)5, history.last());
+  CHECK(!history.contains(1));
+
+  history.reset();
+  CHECK(history.empty());
+  // rolling back an empty history is a no-op
+  history.rollback();
+  CHECK(history.empty());
+}
+
+// streams a ray through a sphere, refiring from each hit point
+void test_streaming(MBVHManager& MBVHM, moab::EntityHandle vol) {
+  moab::ErrorCode rval;
+
+  const Vec3da dir(1.0, 0.0, 0.0);
+  MBRay ray(Vec3da(-100.0, 0.0123, 0.0456), dir);
+  ray.instID = vol;
+
+  rval = MBVHM.fireRay(ray);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  CHECK(ray.primID != (moab::EntityHandle)-1);
+  const moab::EntityHandle entry = ray.primID;
+  // restart just short of the hit so that the facet crossed is in reach
+  const Vec3da hit_pnt = ray.org + (ray.tfar - 1e-4) * ray.dir;
+
+  MBRayHistory history;
+  history.add(entry);
+
+  // without the history the facet just crossed is found again
+  MBRay refire(hit_pnt, dir);
+  refire.instID = vol;
+  rval = MBVHM.fireRay(refire);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  CHECK_EQUAL(entry, refire.primID);
+  CHECK(refire.tfar < 1e-3);
+
+  // with it, the ray exits through the far side of the sphere
+  refire = MBRay(hit_pnt, dir);
+  refire.instID = vol;
+  refire.history = &history;
+  rval = MBVHM.fireRay(refire);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  CHECK(refire.primID != (moab::EntityHandle)-1);
+  CHECK(refire.primID != entry);
+  CHECK(refire.tfar > 1e-3);
+  const moab::EntityHandle exit = refire.primID;
+  const double exit_dist = refire.tfar;
+
+  // the same for the other queries
+  {
+    MBRay r(hit_pnt, dir);
+    r.instID = vol;
+    r.history = &history;
+    MBVHM.MOABBVH->set_short_stack(true);
+    rval = MBVHM.fireRay(r);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+    MBVHM.MOABBVH->set_short_stack(false);
+    CHECK_EQUAL(exit, r.primID);
+
+    std::vector<MBRay> batch(8, r);
+    for(size_t i = 0; i < batch.size(); i++) {
+      batch[i] = MBRay(hit_pnt, dir);
+      batch[i].instID = vol;
+      batch[i].history = &history;
+    }
+    rval = MBVHM.fireRayPackets(&batch[0], batch.size(), 8);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray packet");
+    for(size_t i = 0; i < batch.size(); i++) { CHECK_EQUAL(exit, batch[i].primID); }
+
+    // only the exit remains on a segment ending before it
+    r = MBRay(hit_pnt, dir, 0.0, 0.5*exit_dist);
+    r.instID = vol;
+    bool occluded;
+    rval = MBVHM.fireOcclusionRay(r, occluded);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire occlusion ray");
+    CHECK(occluded);
+    r = MBRay(hit_pnt, dir, 0.0, 0.5*exit_dist);
+    r.instID = vol;
+    r.history = &history;
+    rval = MBVHM.fireOcclusionRay(r, occluded);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire occlusion ray");
+    CHECK(!occluded);
+
+    r = MBRay(hit_pnt, dir);
+    r.instID = vol;
+    r.history = &history;
+    std::vector<MBRayHit> hits;
+    rval = MBVHM.fireRayAllHits(r, hits);
+    MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+    CHECK_EQUAL((size_t)1, hits.size());
+    CHECK_EQUAL(exit, hits[0].primID);
+  }
+
+  // leaving the sphere, nothing is left to hit
+  history.add(exit);
+  const Vec3da exit_pnt = hit_pnt + (exit_dist - 1e-4) * dir;
+  refire = MBRay(exit_pnt, dir);
+  refire.instID = vol;
+  refire.history = &history;
+  rval = MBVHM.fireRay(refire);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  CHECK_EQUAL((moab::EntityHandle)-1, refire.primID);
+
+  // rolling back the exit finds it again
+  history.rollback();
+  refire = MBRay(exit_pnt, dir);
+  refire.instID = vol;
+  refire.history = &history;
+  rval = MBVHM.fireRay(refire);
+  MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+  CHECK_EQUAL(exit, refire.primID);
+}
+
+int main(int argc, char** argv) {
+
+  test_history_ops();
+
+  TestModel model(TEST_SMALL_SPHERE);
+  MB_CHK_SET_ERR(model.rval, "Failed to set up the model");
+
+  test_streaming(*model.MBVHM, model.vols[0]);
+
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_POINTS 1000
+
+// the safety distance never exceeds the distance to the boundary and
+// tightens with the cutoff depth
+void check_safety(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  double sum_ratio = 0.0;
+  size_t num = 0;
+  for (size_t j = 0; j < NUM_POINTS; j++) {
+    moab::EntityHandle vol = vols[j % vols.size()];
+    Vec3da p = random_vec(extent);
+
+    MBRay ray(p, Vec3da(1.0, 0.0, 0.0));
+    ray.instID = vol;
+    rval = MBVHM.closestToLocation(ray);
+    MB_CHK_SET_ERR_RET(rval, "Failed to get the closest location");
+    const double exact = ray.tfar;
+
+    double prev = 0.0, dist;
+    for (size_t depth = 1; depth <= 16; depth++) {
+      rval = MBVHM.safetyDistance(vol, p, dist, depth);
+      MB_CHK_SET_ERR_RET(rval, "Failed to get the safety distance");
+      CHECK(dist >= prev);
+      CHECK(dist <= exact);
+      prev = dist;
+    }
+
+    rval = MBVHM.safetyDistance(vol, p, dist);
+    MB_CHK_SET_ERR_RET(rval, "Failed to get the safety distance");
+    CHECK(dist >= prev);
+    CHECK(dist <= exact);
+    sum_ratio += dist/exact;
+    num++;
+
+    // the search radius caps the bound
+    double capped;
+    rval = MBVHM.safetyDistance(vol, p, capped, (size_t)-1, 0.5*dist);
+    MB_CHK_SET_ERR_RET(rval, "Failed to get the safety distance");
+    CHECK_REAL_EQUAL(0.5*dist, capped, 0.0);
+    rval = MBVHM.safetyDistance(vol, p, capped, (size_t)-1, 2.0*exact);
+    MB_CHK_SET_ERR_RET(rval, "Failed to get the safety distance");
+    CHECK_REAL_EQUAL(dist, capped, 0.0);
+  }
+
+  // with boxes down to the leaves the bound is close to the distance
+  CHECK(sum_ratio/num > 0.5);
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  check_safety(TEST_CUBE, 10.0);
+  check_safety(TEST_CUBE_CYLINDER, 10.0);
+  check_safety(TEST_SMALL_SPHERE, 20.0);
+
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_RAYS 10000
+
+// compare the short stack traversal to the full stack traversal
+void compare_traversals(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  for(moab::Range::iterator i = vols.begin(); i != vols.end(); i++) {
+    for(size_t j = 0; j < NUM_RAYS; j++) {
+
+      // origins both inside and outside of the volumes
+      Vec3da org = random_vec(extent), dir = random_dir();
+      int orientation = (j % 3) - 1;
+
+      MBRay full(org, dir, 0.0, inf, -1, orientation);
+      full.instID = *i;
+      MBVHM.MOABBVH->set_short_stack(false);
+      rval = MBVHM.fireRay(full);
+      MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+
+      MBRay shrt(org, dir, 0.0, inf, -1, orientation);
+      shrt.instID = *i;
+      MBVHM.MOABBVH->set_short_stack(true);
+      rval = MBVHM.fireRay(shrt);
+      MB_CHK_SET_ERR_RET(rval, "Failed to fire ray");
+
+      if ( full.tfar == (double)inf ) {
+	CHECK(shrt.tfar == (double)inf);
+	continue;
+      }
+
+      CHECK_REAL_EQUAL(full.tfar, shrt.tfar, 0.0);
+      CHECK_EQUAL(full.primID, shrt.primID);
+      CHECK_EQUAL(full.geomID, shrt.geomID);
+      CHECK_REAL_EQUAL(full.Ng[0], shrt.Ng[0], 0.0);
+      CHECK_REAL_EQUAL(full.Ng[1], shrt.Ng[1], 0.0);
+      CHECK_REAL_EQUAL(full.Ng[2], shrt.Ng[2], 0.0);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  compare_traversals(TEST_CUBE, 10.0);
+  compare_traversals(TEST_CUBE_CYLINDER, 10.0);
+  compare_traversals(TEST_SMALL_SPHERE, 2.0);
+
+  return 0;
+}
@@ -0,0 +1,201 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_POINTS 2000
+
+// signed distance to the boundary of the cube [-5, 5]^3
+double box_distance(const Vec3da& p) {
+  double q[3], outside = 0.0, inside = -1e37;
+  for (size_t i = 0; i < 3; i++) {
+    q[i] = fabs(p[i]) - 5.0;
+    if (q[i] > 0.0) outside += q[i]*q[i];
+    inside = std::max(inside, q[i]);
+  }
+  return outside > 0.0 ? sqrt(outside) : inside;
+}
+
+void test_cube() {
+
+  TestModel model(TEST_CUBE);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+  CHECK_EQUAL(1, (int)vols.size());
+  moab::EntityHandle vol = vols[0];
+
+  std::vector<Vec3da> points;
+  for (size_t i = 0; i < NUM_POINTS; i++) points.push_back(random_vec(10.0));
+
+  // nearest an edge or a corner of the cube, inside and out
+  points.push_back(Vec3da(6.0, 6.0, 0.0));
+  points.push_back(Vec3da(-6.0, 0.5, 6.0));
+  points.push_back(Vec3da(6.0, 6.0, 6.0));
+  points.push_back(Vec3da(-5.5, 5.5, -7.0));
+  points.push_back(Vec3da(4.9, 4.9, 0.0));
+  points.push_back(Vec3da(4.9, -4.9, 4.9));
+  // on the diagonal of a face, where two facets meet
+  points.push_back(Vec3da(5.5, 1.0, 1.0));
+  points.push_back(Vec3da(4.5, -1.0, -1.0));
+
+  for (size_t i = 0; i < points.size(); i++) {
+    double dist;
+    rval = MBVHM.signedDistance(vol, points[i], dist);
+    MB_CHK_SET_ERR_RET(rval, "Failed to get the signed distance");
+    CHECK_REAL_EQUAL(box_distance(points[i]), dist, 1e-10);
+  }
+
+  std::vector<double> dists;
+  rval = MBVHM.signedDistances(vol, &points[0], points.size(), dists);
+  MB_CHK_SET_ERR_RET(rval, "Failed to get the signed distances");
+  CHECK_EQUAL(points.size(), dists.size());
+  for (size_t i = 0; i < points.size(); i++) CHECK_REAL_EQUAL(box_distance(points[i]), dists[i], 1e-10);
+}
+
+// the sign agrees with containment by ray in every volume
+void compare_sign(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<Vec3da> points(NUM_POINTS);
+  for (size_t i = 0; i < points.size(); i++) points[i] = random_vec(extent);
+
+  for (moab::Range::iterator vi = vols.begin(); vi != vols.end(); vi++) {
+    std::vector<double> dists;
+    rval = MBVHM.signedDistances(*vi, &points[0], points.size(), dists);
+    MB_CHK_SET_ERR_RET(rval, "Failed to get the signed distances");
+
+    size_t num_inside = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+      int inside;
+      rval = MBVHM.pointInVolume(*vi, points[i], inside, PIV_RAY);
+      MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+      CHECK_EQUAL(inside, dists[i] < 0.0 ? 1 : 0);
+
+      MBRay ray(points[i], Vec3da(1.0, 0.0, 0.0));
+      ray.instID = *vi;
+      rval = MBVHM.closestToLocation(ray);
+      MB_CHK_SET_ERR_RET(rval, "Failed to get the closest location");
+      CHECK_REAL_EQUAL(ray.tfar, fabs(dists[i]), 0.0);
+      num_inside += inside;
+    }
+    CHECK(num_inside > 0);
+  }
+}
+
+// a regular tetrahedron, the faces of a sharp vertex or edge of which
+// point away from some of the points nearest to it
+moab::EntityHandle make_tetrahedron(moab::Interface* mbi, Vec3da corners[4]) {
+  moab::Tag dim_tag, sense_tag;
+  mbi->tag_get_handle(GEOM_DIMENSION_TAG_NAME, 1, moab::MB_TYPE_INTEGER, dim_tag, moab::MB_TAG_SPARSE|moab::MB_TAG_CREAT);
+  mbi->tag_get_handle("GEOM_SENSE_2", 2, moab::MB_TYPE_HANDLE, sense_tag, moab::MB_TAG_SPARSE|moab::MB_TAG_CREAT);
+
+  corners[0] = Vec3da(1.0, 1.0, 1.0);
+  corners[1] = Vec3da(1.0, -1.0, -1.0);
+  corners[2] = Vec3da(-1.0, 1.0, -1.0);
+  corners[3] = Vec3da(-1.0, -1.0, 1.0);
+
+  moab::EntityHandle verts[4];
+  for (size_t i = 0; i < 4; i++) {
+    double c[3] = {corners[i][0], corners[i][1], corners[i][2]};
+    mbi->create_vertex(c, verts[i]);
+  }
+
+  moab::EntityHandle surf, vol;
+  mbi->create_meshset(0, surf);
+  mbi->create_meshset(0, vol);
+  int dim = 2;
+  mbi->tag_set_data(dim_tag, &surf, 1, &dim);
+  dim = 3;
+  mbi->tag_set_data(dim_tag, &vol, 1, &dim);
+  moab::EntityHandle senses[2] = {vol, 0};
+  mbi->tag_set_data(sense_tag, &surf, 1, senses);
+  mbi->add_parent_child(vol, surf);
+
+  // the face opposite each corner, oriented away from it
+  for (size_t i = 0; i < 4; i++) {
+    size_t a = (i+1)%4, b = (i+2)%4, c = (i+3)%4;
+    if (dot(cross(corners[b]-corners[a], corners[c]-corners[a]), corners[a]-corners[i]) < 0.0) std::swap(b, c);
+    moab::EntityHandle conn[3] = {verts[a], verts[b], verts[c]}, tri;
+    mbi->create_element(moab::MBTRI, conn, 3, tri);
+    mbi->add_entities(surf, &tri, 1);
+  }
+
+  return vol;
+}
+
+void test_tetrahedron() {
+
+  moab::Interface* mbi = new moab::Core();
+
+  moab::ErrorCode rval;
+
+  Vec3da corners[4];
+  moab::EntityHandle vol = make_tetrahedron(mbi, corners);
+
+  MBVHManager MBVHM(mbi);
+
+  rval = MBVHM.build_all();
+  MB_CHK_SET_ERR_RET(rval, "Failed to build trees for the model");
+
+  // outward normal of the face opposite each corner
+  Vec3da n[4];
+  for (size_t i = 0; i < 4; i++) n[i] = corners[i] * (-1.0/sqrt(3.0));
+
+  // nearest the corner 0, mostly along the normal of one of its faces
+  Vec3da dir = 0.1 * n[1] + 0.1 * n[2] + 0.8 * n[3];
+  dir.normalize();
+  CHECK(dot(dir, n[1]) < 0.0);
+  double dist;
+  rval = MBVHM.signedDistance(vol, corners[0] + 0.5 * dir, dist);
+  MB_CHK_SET_ERR_RET(rval, "Failed to get the signed distance");
+  CHECK_REAL_EQUAL(0.5, dist, 1e-12);
+
+  // nearest the middle of the edge from corner 0 to 1
+  dir = 0.2 * n[2] + 0.8 * n[3];
+  dir.normalize();
+  CHECK(dot(dir, n[2]) < 0.0);
+  rval = MBVHM.signedDistance(vol, 0.5 * (corners[0] + corners[1]) + 0.5 * dir, dist);
+  MB_CHK_SET_ERR_RET(rval, "Failed to get the signed distance");
+  CHECK_REAL_EQUAL(0.5, dist, 1e-12);
+
+  // inside, the distance is to the nearest face plane
+  for (size_t j = 0; j < NUM_POINTS; j++) {
+    Vec3da p = random_vec(0.5);
+    if (p.length() > 0.5) continue;
+    double expected = -1e37;
+    for (size_t i = 0; i < 4; i++) expected = std::max(expected, dot(p, n[i]) - 1.0/sqrt(3.0));
+    rval = MBVHM.signedDistance(vol, p, dist);
+    MB_CHK_SET_ERR_RET(rval, "Failed to get the signed distance");
+    CHECK_REAL_EQUAL(expected, dist, 1e-12);
+  }
+
+  // cleanup
+  delete mbi;
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  test_cube();
+  test_tetrahedron();
+  compare_sign(TEST_CUBE_CYLINDER, 10.0);
+  compare_sign(TEST_SMALL_SPHERE, 20.0);
+
+  return 0;
+}
@@ -0,0 +1,200 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cmath>
+#include <cstdlib>
+
+#define NUM_RAYS 5000
+
+// global id of an entity set, 0 for no set
+int global_id(moab::Interface* mbi, moab::EntityHandle entset);
+
+// a crossing by the global ids of its volumes and surface
+struct Crossing {
+  int volume;
+  int surface;
+  double dist;
+  int next;
+};
+
+moab::EntityHandle volume_with_id(moab::Interface* mbi, int id) {
+  moab::Range vols;
+  moab::ErrorCode rval = get_geom_sets_with_dim(mbi, 3, vols);
+  MB_CHK_SET_ERR_CONT(rval, "Failed to retrieve volumes from MOAB instance");
+  for(moab::Range::iterator vi = vols.begin(); vi != vols.end(); vi++) {
+    if(global_id(mbi, *vi) == id) return *vi;
+  }
+  return 0;
+}
+
+// walk a track from the volume with global id vol and compare its
+// crossings with the expected ones
+void check_track(moab::Interface* mbi, MBVHManager& MBVHM, int vol, Vec3da org, Vec3da dir, double tfar,
+		 const Crossing* expected, size_t num_expected) {
+  dir.normalize();
+  MBRay ray(org, dir);
+  ray.tfar = tfar;
+  ray.instID = volume_with_id(mbi, vol);
+  CHECK(ray.instID);
+
+  std::vector<MBTrackCrossing> crossings;
+  moab::ErrorCode rval = MBVHM.walkTrack(ray, crossings);
+  MB_CHK_SET_ERR_RET(rval, "Failed to walk the track");
+
+  CHECK_EQUAL(num_expected, crossings.size());
+  for(size_t i = 0; i < crossings.size(); i++) {
+    CHECK_EQUAL(expected[i].volume, global_id(mbi, crossings[i].volume));
+    CHECK_EQUAL(expected[i].surface, global_id(mbi, crossings[i].surface));
+    CHECK_REAL_EQUAL(expected[i].dist, crossings[i].dist, 1e-12);
+    CHECK_EQUAL(expected[i].next, global_id(mbi, crossings[i].next));
+  }
+}
+
+// The faces of the cube model span [-5, 5] and are split into two
+// triangles along a diagonal. Tracks from the center through the middle
+// of a face cross it on the edge shared by its triangles.
+void test_cube_tracks() {
+  moab::Interface* mbi = new moab::Core();
+
+  moab::ErrorCode rval = mbi->load_file(TEST_CUBE);
+  MB_CHK_SET_ERR_RET(rval, "Failed to load the test file");
+
+  MBVHManager MBVHM(mbi);
+  rval = MBVHM.build_all();
+  MB_CHK_SET_ERR_RET(rval, "Failed to build trees for the model");
+
+  // out through the top face, diagonal x + y = 0
+  Crossing top[] = { {1, 1, 5.0, 0} };
+  check_track(mbi, MBVHM, 1, Vec3da(0.0, 0.0, 0.0), Vec3da(0.0, 0.0, 1.0), inf, top, 1);
+
+  // out through the -x face, diagonal y + z = 0
+  Crossing side[] = { {1, 4, 5.0, 0} };
+  check_track(mbi, MBVHM, 1, Vec3da(0.0, 0.0, 0.0), Vec3da(-1.0, 0.0, 0.0), inf, side, 1);
+
+  // off the diagonals
+  Crossing off[] = { {1, 6, 4.0, 0} };
+  check_track(mbi, MBVHM, 1, Vec3da(1.0, 2.0, 3.0), Vec3da(1.0, 0.0, 0.0), inf, off, 1);
+
+  // ending short of the boundary
+  check_track(mbi, MBVHM, 1, Vec3da(1.0, 2.0, 3.0), Vec3da(1.0, 0.0, 0.0), 2.0, NULL, 0);
+
+  delete mbi;
+}
+
+// The cube_cyl model is the cube (volume 2) with a cylinder of radius 4
+// (volume 3) standing on its top face from z = 5 to 10. They share the
+// disc at z = 5 (surface 11), which is triangulated in strips whose
+// edges at y = YEDGE run exactly along the x axis, so tracks at x = 0,
+// y = YEDGE cross into the neighbouring volume on an edge shared by two
+// triangles.
+#define YEDGE 2.0983587307138745
+
+void test_cube_cyl_tracks() {
+  moab::Interface* mbi = new moab::Core();
+
+  moab::ErrorCode rval = mbi->load_file(TEST_CUBE_CYLINDER);
+  MB_CHK_SET_ERR_RET(rval, "Failed to load the test file");
+
+  MBVHManager MBVHM(mbi);
+  rval = MBVHM.build_all();
+  MB_CHK_SET_ERR_RET(rval, "Failed to build trees for the model");
+
+  // up from the cube through the cylinder and out of its top
+  Crossing up[] = { {2, 11, 5.0, 3},
+		    {3, 12, 10.0, 0} };
+  check_track(mbi, MBVHM, 2, Vec3da(0.0, YEDGE, 0.0), Vec3da(0.0, 0.0, 1.0), inf, up, 2);
+
+  // down from the cylinder through the cube and out of its bottom
+  Crossing down[] = { {3, 11, 4.0, 2},
+		      {2, 5, 14.0, 0} };
+  check_track(mbi, MBVHM, 3, Vec3da(0.0, YEDGE, 9.0), Vec3da(0.0, 0.0, -1.0), inf, down, 2);
+
+  // up from the cube outside of the disc
+  Crossing outside[] = { {2, 13, 5.0, 0} };
+  check_track(mbi, MBVHM, 2, Vec3da(4.5, 4.5, 0.0), Vec3da(0.0, 0.0, 1.0), inf, outside, 1);
+
+  // ending inside the cylinder
+  check_track(mbi, MBVHM, 2, Vec3da(0.0, YEDGE, 0.0), Vec3da(0.0, 0.0, 1.0), 7.0, up, 1);
+
+  // stopping on entering the cylinder as the graveyard
+  MBVHM.graveyard = volume_with_id(mbi, 3);
+  check_track(mbi, MBVHM, 2, Vec3da(0.0, YEDGE, 0.0), Vec3da(0.0, 0.0, 1.0), inf, up, 1);
+  MBVHM.graveyard = 0;
+
+  delete mbi;
+}
+
+// random tracks enter the volume each crossing leads to and never cross
+// straight back out at the same distance
+void check_random_tracks(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<MBTrackCrossing> crossings;
+  size_t num_crossings = 0;
+  for(size_t j = 0; j < NUM_RAYS; j++) {
+    MBRay ray(random_vec(extent), random_dir());
+    ray.instID = vols[j % vols.size()];
+
+    rval = MBVHM.walkTrack(ray, crossings);
+    MB_CHK_SET_ERR_RET(rval, "Failed to walk the track");
+    num_crossings += crossings.size();
+
+    for(size_t i = 0; i < crossings.size(); i++) {
+      CHECK(crossings[i].next != crossings[i].volume);
+      if(!i) {
+	CHECK_EQUAL((moab::EntityHandle)ray.instID, crossings[i].volume);
+	continue;
+      }
+      CHECK_EQUAL(crossings[i-1].next, crossings[i].volume);
+      CHECK(crossings[i].dist >= crossings[i-1].dist);
+      if(crossings[i].next == crossings[i-1].volume) CHECK(crossings[i].dist > crossings[i-1].dist);
+    }
+    if(!crossings.empty()) CHECK(!crossings.back().next);
+  }
+  CHECK(num_crossings > 0);
+}
+
+int main(int argc, char** argv) {
+
+  test_cube_tracks();
+  test_cube_cyl_tracks();
+
+  srand(42);
+
+  check_random_tracks(TEST_CUBE, 10.0);
+  check_random_tracks(TEST_CUBE_CYLINDER, 10.0);
+  check_random_tracks(TEST_SMALL_SPHERE, 20.0);
+
+  return 0;
+}
+
+int global_id(moab::Interface* mbi, moab::EntityHandle entset) {
+  if(!entset) return 0;
+
+  moab::ErrorCode rval;
+
+  moab::Tag id_tag;
+  int id;
+
+  rval = mbi->tag_get_handle(GLOBAL_ID_TAG_NAME, 1, moab::MB_TYPE_INTEGER, id_tag,
+			     moab::MB_TAG_SPARSE);
+  MB_CHK_SET_ERR_CONT(rval, "Failed to get tag with name: " << GLOBAL_ID_TAG_NAME);
+  if (rval != moab::MB_SUCCESS) return -1;
+
+  rval = mbi->tag_get_data(id_tag,&(entset),1,&id);
+  MB_CHK_SET_ERR_CONT(rval, "Failed to get id for entityset " << entset);
+  if (rval != moab::MB_SUCCESS) return -1;
+
+  return id;
+}
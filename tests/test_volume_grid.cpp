@@ -0,0 +1,137 @@
+#include "test_files.h"
+#include "testutil.hpp"
+#include "moab/Core.hpp"
+
+#include "MBVHManager.h"
+#include "test_model.hpp"
+
+#include <cstdlib>
+
+#define NUM_POINTS 1000
+
+// queries answered from the grid agree with the trees
+void check_grid(const char* filename, double extent) {
+
+  TestModel model(filename);
+  MB_CHK_SET_ERR_RET(model.rval, "Failed to set up the model");
+
+  MBVHManager& MBVHM = *model.MBVHM;
+  const moab::Range& vols = model.vols;
+
+  moab::ErrorCode rval;
+
+  std::vector<Vec3da> points(NUM_POINTS);
+  for (size_t i = 0; i < points.size(); i++) points[i] = random_vec(extent);
+
+  // answers without a grid
+  std::vector<std::vector<int> > expected(vols.size());
+  std::vector<std::vector<double> > exact(vols.size());
+  for (size_t v = 0; v < vols.size(); v++) {
+    rval = MBVHM.pointsInVolume(vols[v], &points[0], points.size(), expected[v]);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify points");
+    for (size_t i = 0; i < points.size(); i++) {
+      MBRay ray(points[i], Vec3da(1.0, 0.0, 0.0));
+      ray.instID = vols[v];
+      rval = MBVHM.closestToLocation(ray);
+      MB_CHK_SET_ERR_RET(rval, "Failed to get the closest location");
+      exact[v].push_back(ray.tfar);
+    }
+  }
+
+  rval = MBVHM.build_grids(16);
+  MB_CHK_SET_ERR_RET(rval, "Failed to build the grids");
+  CHECK_EQUAL(vols.size(), MBVHM.grids.size());
+
+  size_t num_inside = 0;
+  for (size_t v = 0; v < vols.size(); v++) {
+    const VolumeGrid& grid = MBVHM.grids[vols[v]];
+    CHECK(grid.size() > 0);
+    for (size_t c = 0; c < grid.size(); c++) {
+      if (grid.label(c) == VolumeGrid::CELL_INSIDE) num_inside++;
+    }
+
+    for (size_t i = 0; i < points.size(); i++) {
+      int result;
+      rval = MBVHM.pointInVolume(vols[v], points[i], result);
+      MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+      CHECK_EQUAL(expected[v][i], result);
+
+      double dist;
+      rval = MBVHM.safetyDistance(vols[v], points[i], dist);
+      MB_CHK_SET_ERR_RET(rval, "Failed to get the safety distance");
+      CHECK(dist <= exact[v][i]);
+    }
+  }
+  CHECK(num_inside > 0);
+
+  // rebuilding ignores a stale grid, here one with every label flipped
+  moab::EntityHandle vol = vols[0];
+  VolumeGrid& stale = MBVHM.grids[vol];
+  for (size_t c = 0; c < stale.size(); c++) {
+    if (stale.label(c) == VolumeGrid::CELL_INSIDE) stale.set(c, VolumeGrid::CELL_OUTSIDE, stale.bound(c));
+    else if (stale.label(c) == VolumeGrid::CELL_OUTSIDE) stale.set(c, VolumeGrid::CELL_INSIDE, stale.bound(c));
+  }
+  rval = MBVHM.build_grid(vol, 16);
+  MB_CHK_SET_ERR_RET(rval, "Failed to build the grid");
+  for (size_t i = 0; i < points.size(); i++) {
+    int result;
+    rval = MBVHM.pointInVolume(vol, points[i], result);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+    CHECK_EQUAL(expected[0][i], result);
+  }
+
+  // the memory budget limits the resolution
+  const size_t budget = 1000*VolumeGrid::bytesPerCell;
+  rval = MBVHM.build_grid(vol, 64, budget);
+  MB_CHK_SET_ERR_RET(rval, "Failed to build the grid");
+  CHECK(MBVHM.grids[vol].size() > 0);
+  CHECK(MBVHM.grids[vol].size()*VolumeGrid::bytesPerCell <= budget);
+
+  // no grid if a single cell does not fit, queries use the tree
+  rval = MBVHM.build_grid(vol, 64, 0);
+  MB_CHK_SET_ERR_RET(rval, "Failed to build the grid");
+  CHECK(MBVHM.grids.find(vol) == MBVHM.grids.end());
+  for (size_t i = 0; i < points.size(); i++) {
+    int result;
+    rval = MBVHM.pointInVolume(vol, points[i], result);
+    MB_CHK_SET_ERR_RET(rval, "Failed to classify point");
+    CHECK_EQUAL(expected[0][i], result);
+  }
+}
+
+// boxes without extent get no grid, flat boxes get one layer of cells
+void test_degenerate_boxes() {
+
+  VolumeGrid grid;
+
+  CHECK(!grid.setup(AABB(1.0f, 2.0f, 3.0f, 1.0f, 2.0f, 3.0f), 32, 1 << 20));
+  CHECK(grid.empty());
+  CHECK_EQUAL((size_t)0, grid.size());
+
+  CHECK(!grid.setup(AABB(), 32, 1 << 20));
+  CHECK(grid.empty());
+
+  CHECK(!grid.setup(AABB(0.0f, 0.0f, 0.0f, inf, 1.0f, 1.0f), 32, 1 << 20));
+  CHECK(grid.empty());
+
+  CHECK(grid.setup(AABB(0.0f, 0.0f, 1.0f, 4.0f, 2.0f, 1.0f), 4, 1 << 20));
+  CHECK_EQUAL((size_t)8, grid.size());
+
+  size_t c;
+  CHECK(grid.cell(Vec3da(3.5, 1.5, 1.0), c));
+  CHECK_EQUAL((size_t)7, c);
+  CHECK(!grid.cell(Vec3da(3.5, 1.5, 0.5), c));
+}
+
+int main(int argc, char** argv) {
+
+  srand(42);
+
+  test_degenerate_boxes();
+
+  check_grid(TEST_CUBE, 10.0);
+  check_grid(TEST_CUBE_CYLINDER, 10.0);
+  check_grid(TEST_SMALL_SPHERE, 20.0);
+
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include<string>
+#include<ctime>
+
+#include "moab/ProgOptions.hpp"
+
+#include "moab/Core.hpp"
+#include "moab/CartVect.hpp"
+
+#include "MBVHManager.h"
+
+#include "diffutil.hpp"
+
+#include <iostream>
+
+int main(int argc, char** argv) {
+
+  moab::ErrorCode rval;
+
+  // options handling
+  ProgOptions po("A tool for comparing BVH query results with a brute force reference on a DagMC geometry.");
+
+  std::string filename;
+  po.addRequiredArg<std::string>("MOAB Model", "Filename of the MOAB model.", &filename);
+
+  int vol_gid = -1;
+  po.addOpt<int>("vol-id,i", "Specify the volume to test (default is all volumes)", &vol_gid);
+
+  int num_queries = 1000000;
+  po.addOpt<int>("num_queries,n", "Specify the number of queries of each kind per volume (default 1000000)", &num_queries);
+
+  int seed = 1;
+  po.addOpt<int>("seed,s", "Seed for the random number generator (default 1)", &seed);
+
+  double tolerance = 1e-09;
+  po.addOpt<double>("tolerance,t", "Relative tolerance for distance comparisons (default 1e-09)", &tolerance);
+
+  bool verbose = false;
+  po.addOpt<void>("verbose,v", "Print every mismatching query", &verbose);
+
+  po.addOptionHelpHeading("Query kinds: random, vertex, edge, grazing, distant and closest location");
+
+  po.parseCommandLine(argc, argv);
+
+  srand(seed);
+
+  // create the MOAB instance and load the file
+  moab::Interface* MBI = new moab::Core();
+  rval = MBI->load_file(filename.c_str());
+  MB_CHK_SET_ERR(rval, "Failed to load file: " << filename << std::endl);
+
+  // initiate a BVH manager and build all trees for geometric entity sets
+  MBVHManager* BVHManager = new MBVHManager(MBI);
+  rval = BVHManager->build_all();
+  MB_CHK_SET_ERR(rval, "Failed to build trees");
+
+  // collect the volumes to test
+  moab::Tag geom_dim_tag, gid_tag;
+  rval = MBI->tag_get_handle(GEOM_DIMENSION_TAG_NAME, geom_dim_tag);
+  MB_CHK_SET_ERR(rval, "Failed to get the geom dim tag handle");
+  rval = MBI->tag_get_handle(GLOBAL_ID_TAG_NAME, gid_tag);
+  MB_CHK_SET_ERR(rval, "Failed to retrieve the global id tag");
+
+  moab::Range vols;
+  int dim = 3;
+  void *ptr = &dim;
+  rval = MBI->get_entities_by_type_and_tag(0, moab::MBENTITYSET, &geom_dim_tag, &ptr, 1, vols);
+  MB_CHK_SET_ERR(rval, "Failed to retrieve volume entitysets");
+
+  DiffHarness harness(MBI, BVHManager, tolerance);
+  harness.verbose = verbose;
+
+  std::clock_t start = std::clock();
+
+  size_t vols_tested = 0;
+  for(moab::Range::iterator i = vols.begin(); i != vols.end(); i++) {
+    moab::EntityHandle vol = *i;
+
+    int gid;
+    rval = MBI->tag_get_data(gid_tag, &vol, 1, &gid);
+    MB_CHK_SET_ERR(rval, "Failed to get the volume global id");
+    if( vol_gid != -1 && gid != vol_gid ) continue;
+
+    // skip volumes without triangles (e.g. the implicit complement)
+    moab::Range surfs;
+    rval = MBI->get_child_meshsets(vol, surfs);
+    MB_CHK_SET_ERR(rval, "Failed to get child surfaces of volume " << gid);
+    if( surfs.empty() ) continue;
+
+    std::cout << "Testing volume " << gid << std::endl;
+    rval = harness.run_all(vol, num_queries);
+    MB_CHK_SET_ERR(rval, "Failed differential run for volume " << gid);
+    vols_tested++;
+  }
+
+  if( !vols_tested ) {
+    MB_CHK_SET_ERR(moab::MB_FAILURE, "No volumes found to test");
+  }
+
+  double duration = (std::clock() - start) / (double) CLOCKS_PER_SEC;
+
+  harness.report(std::cout);
+  std::cout << "Volumes tested: " << vols_tested << std::endl;
+  std::cout << "Run time: " << duration << " seconds" << std::endl;
+
+  delete BVHManager;
+  delete MBI;
+
+  return harness.mismatches() ? 1 : 0;
+}
@@ -92,6 +92,27 @@ int main(int argc, char** argv) {
   po.addOpt<double>("dir_y,v",  "Specify the y-direction of single ray generation");
   po.addOpt<double>("dir_z,w",  "Specify the z-direction of single ray generation");
 
+  int child_order = CHILD_ORDER_DISTANCE;
+  po.addOpt<int>("child_order,o", "Child visiting order: 0 distance (default), 1 SIMD distance", &child_order);
+
+  bool octant_kernels = false;
+  po.addOpt<void>("octant_kernels,k", "Use traversal kernels specialized on the ray direction octant", &octant_kernels);
+
+  int batch_size = 0;
+  po.addOpt<int>("batch,b", "Fire random rays in batches of this size, grouped by direction octant (default 0, one at a time)", &batch_size);
+
+  int packet_size = 0;
+  po.addOpt<int>("packet,P", "Fire each batch of random rays in packets of 4 or 8 rays (requires -b)", &packet_size);
+
+  int rays_in_flight = 1;
+  po.addOpt<int>("rays_in_flight,f", "Number of rays of a batch traversed together, interleaving their node fetches (requires -b, default 1)", &rays_in_flight);
+
+  bool static_far = false;
+  po.addOpt<void>("static_far,F", "Keep the far distance of box tests at its initial value rather than shrinking it to the closest hit", &static_far);
+
+  bool any_hit = false;
+  po.addOpt<void>("any_hit,a", "Fire random rays as occlusion queries, stopping at the first hit found", &any_hit);
+
   std::string python_dict;
   po.addOpt<std::string>("p", "if present, save parameters and results to a python dictionary file", &python_dict);
 
@@ -109,6 +130,25 @@ int main(int argc, char** argv) {
   rval = BVHManager->build_all();
   MB_CHK_SET_ERR(rval, "Failed to build trees");
 
+  if( child_order < CHILD_ORDER_DISTANCE || child_order > CHILD_ORDER_DISTANCE_SIMD ) {
+    MB_CHK_SET_ERR(moab::MB_FAILURE, "Invalid child order: " << child_order);
+  }
+  BVHManager->MOABBVH->set_child_order((ChildOrder)child_order);
+  BVHManager->MOABBVH->set_octant_kernels(octant_kernels);
+
+  if( packet_size && batch_size <= 0 ) {
+    MB_CHK_SET_ERR(moab::MB_FAILURE, "Ray packets require a batch size (-b)");
+  }
+
+  if( rays_in_flight < 1 ) {
+    MB_CHK_SET_ERR(moab::MB_FAILURE, "Invalid number of rays in flight: " << rays_in_flight);
+  }
+  BVHManager->MOABBVH->set_rays_in_flight(rays_in_flight);
+  BVHManager->MOABBVH->set_dynamic_far(!static_far);
+
+  TraversalStats trav_counts;
+  if(trav_stats) BVHManager->MOABBVH->set_traversal_stats(&trav_counts);
+
   moab::EntityHandle volume;
   rval = set_volume(MBI, vol_gid, volume);
   MB_CHK_SET_ERR(rval, "Failed to get and set the volume");
@@ -214,6 +254,7 @@ int main(int argc, char** argv) {
 
     MBRay ray;
     moab::CartVect org, dir;
+    std::vector<MBRay> batch;
 
     org = moab::CartVect(rand_ray_center);
     for(int i = 0; i < num_rand_rays; i++){
@@ -227,8 +268,42 @@ int main(int argc, char** argv) {
       ray = MBRay(org.array(), dir.array());
       ray.instID = volume;
 
+      if( batch_size > 0 ) {
+	batch.push_back(ray);
+	if( (int)batch.size() < batch_size && i < num_rand_rays - 1 ) continue;
+
+	// fire and time the batch
+	rays_fired += batch.size();
+	start = std::clock();
+	if( any_hit ) {
+	  std::vector<bool> occluded;
+	  rval = BVHManager->fireOcclusionRays(&(batch[0]), batch.size(), occluded);
+	  duration += std::clock() - start;
+	  MB_CHK_SET_ERR(rval, "Failed to fire occlusion ray batch");
+	  for(size_t j = 0; j < occluded.size(); j++) { if(!occluded[j]) { rays_missed++; } }
+	  batch.clear();
+	  continue;
+	}
+	if( packet_size ) rval = BVHManager->fireRayPackets(&(batch[0]), batch.size(), packet_size);
+	else rval = BVHManager->fireRays(&(batch[0]), batch.size());
+	duration += std::clock() - start;
+	MB_CHK_SET_ERR(rval, "Failed to fire ray batch");
+	for(size_t j = 0; j < batch.size(); j++) { if(batch[j].geomID == -1) { rays_missed++; } }
+	batch.clear();
+	continue;
+      }
+
       // fire and time the ray
       rays_fired++;
+      if( any_hit ) {
+	bool occluded;
+	start = std::clock();
+	rval = BVHManager->fireOcclusionRay(ray, occluded);
+	duration += std::clock() - start;
+	MB_CHK_SET_ERR(rval, "Failed to fire occlusion ray");
+	if(!occluded) { rays_missed++; }
+	continue;
+      }
       start = std::clock();
       rval = BVHManager->fireRay(ray);
       duration += std::clock() - start;
@@ -239,6 +314,11 @@ int main(int argc, char** argv) {
 
   report(rays_missed, rays_fired, duration);
 
+  if(trav_stats) {
+    std::cout << std::endl << "Traversal statistics" << std::endl;
+    trav_counts.print(std::cout);
+  }
+
   return rval;
 }
 